@@ -0,0 +1,23 @@
+#version 100
+
+precision highp float;
+
+attribute vec2 position;
+attribute vec2 instanceOffset;
+attribute vec2 instanceVelocity;
+attribute vec4 instanceColor;
+attribute vec2 instanceTime;
+uniform mat4 projection;
+uniform float time;
+varying vec4 instanceColorFrag;
+
+void main() {
+	float age = mod(time - instanceTime.x, 8388608.0);
+	if (age > instanceTime.y) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		instanceColorFrag = vec4(0.0);
+		return;
+	}
+	gl_Position = projection * vec4(position + instanceOffset + age * instanceVelocity, 1.0, 1.0);
+	instanceColorFrag = vec4(instanceColor.rgb, instanceColor.a * (1.0 - age / instanceTime.y));
+}
@@ -3,7 +3,8 @@
 precision highp float;
 
 uniform vec4 color;
+varying vec4 vertexColorFrag;
 
 void main() {
-	gl_FragColor = color;
+	gl_FragColor = color * vertexColorFrag;
 }
@@ -1,8 +1,11 @@
 #version 100
 
 attribute vec2 position;
+attribute vec4 vertexColor;
 uniform mat4 projection;
+varying vec4 vertexColorFrag;
 
 void main() {
 	gl_Position = projection * vec4(position, 1.0, 1.0);
+	vertexColorFrag = vertexColor;
 }
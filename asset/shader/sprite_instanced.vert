@@ -0,0 +1,15 @@
+#version 100
+
+attribute vec2 position;
+attribute vec4 instanceDst;
+attribute vec4 instanceSrc;
+attribute vec4 instanceColor;
+uniform mat4 projection;
+varying vec2 texCoordFrag;
+varying vec4 vertexColorFrag;
+
+void main() {
+	gl_Position = projection * vec4(instanceDst.xy + position * instanceDst.zw, 1.0, 1.0);
+	texCoordFrag = mix(instanceSrc.xy, instanceSrc.zw, position);
+	vertexColorFrag = instanceColor;
+}
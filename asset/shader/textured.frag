@@ -5,7 +5,8 @@ precision highp float;
 uniform vec4 color;
 uniform sampler2D tex;
 varying vec2 texCoordFrag;
+varying vec4 vertexColorFrag;
 
 void main() {
-	gl_FragColor = color * texture2D(tex, texCoordFrag);
+	gl_FragColor = color * vertexColorFrag * texture2D(tex, texCoordFrag);
 }
@@ -2,10 +2,13 @@
 
 attribute vec2 position;
 attribute vec2 texCoord;
+attribute vec4 vertexColor;
 uniform mat4 projection;
 varying vec2 texCoordFrag;
+varying vec4 vertexColorFrag;
 
 void main() {
 	gl_Position = projection * vec4(position, 1.0, 1.0);
 	texCoordFrag = texCoord;
+	vertexColorFrag = vertexColor;
 }
@@ -6,15 +6,57 @@
 struct audio_t;
 typedef struct audio_t audio_t;
 
+struct audio_stream_t;
+typedef struct audio_stream_t audio_stream_t;
+struct audio_load_t;
+typedef struct audio_load_t audio_load_t;
+
+typedef struct audio_stats_t {
+    int queue_depth;
+    int queue_peak;
+    int dropped;
+    int samples;
+    float latency;
+    int underruns;
+    float callback_mean;
+    float callback_peak;
+} audio_stats_t;
+
+typedef enum {
+    AUDIO_LATENCY_DEFAULT,
+    AUDIO_LATENCY_LOW
+} audio_latency;
+
+typedef enum {
+    AUDIO_STEAL_OLDEST,
+    AUDIO_STEAL_QUIETEST
+} audio_steal;
+
 typedef struct sound_t {
+    audio_t *audio;
     uint32_t buffer_size;
     uint8_t *buffer;
+    int polyphony;
+    audio_steal steal;
+    audio_stream_t *stream;
+    audio_load_t *load;
 } sound_t;
 
 audio_t *audio_new();
+audio_t *audio_new_ext(audio_latency latency);
+void audio_update(audio_t *self);
 sound_t *audio_load_sound(audio_t *self, const char *filename);
+sound_t *audio_load_sound_async(audio_t *self, const char *filename);
+bool audio_sound_ready(sound_t *sound);
+sound_t *audio_load_stream(audio_t *self, const char *filename);
 void audio_sound_play(audio_t *self, sound_t *sound);
+void audio_sound_play_ext(audio_t *self, sound_t *sound, float gain, float pan);
+void audio_sound_stop(audio_t *self, sound_t *sound);
+void audio_volume(audio_t *self, float volume);
+audio_stats_t audio_stats(audio_t *self);
 void audio_sound_delete(sound_t *sound);
 void audio_delete(audio_t *self);
+void audio_bench_mix();
+void audio_bench_latency();
 
 #endif
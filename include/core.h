@@ -15,7 +15,16 @@
 void core_init();
 void *malloc_ext(size_t size);
 void *realloc_ext(void *memory, size_t size);
-size_t file_read(const char *filename, char *buffer, size_t size);
+char *file_read_all(const char *filename, size_t *size);
+
+void job_init();
+int job_workers();
+void job_parallel_for(size_t count, size_t grain, void (*fn)(void*, size_t, size_t), void *userdata);
+void job_submit(void (*fn)(void*, size_t, size_t), void *userdata);
+void job_shutdown();
+
+void bench_array();
+void bench_pool();
 
 #define iterator_has_next(iterator) ((iterator).has_next(&(iterator)))
 #define iterator_next(iterator) ((iterator).next(&(iterator)))
@@ -47,9 +56,39 @@ void *array_get_last(array_t *self);
 bool array_remove(array_t *self, int index);
 bool array_remove_first(array_t *self);
 bool array_remove_last(array_t *self);
+bool array_remove_swap(array_t *self, int index);
+size_t array_filter(array_t *self, bool (*predicate)(void*, void*), void *userdata);
 iterator_t array_iterator(array_t *self);
 void array_delete(array_t *self);
 
+typedef struct pool_t {
+    size_t padding;
+    size_t count;
+    size_t size;
+    void *free;
+    void *pages;
+} pool_t;
+
+pool_t *pool_new(size_t padding);
+void *pool_alloc(pool_t *self);
+void pool_free(pool_t *self, void *item);
+void pool_delete(pool_t *self);
+
+typedef struct arena_t {
+    size_t capacity;
+    size_t offset;
+    size_t used;
+    size_t peak;
+    char *block;
+    void *blocks;
+} arena_t;
+
+arena_t *arena_new(size_t capacity);
+void *arena_alloc(arena_t *self, size_t size);
+char *arena_printf(arena_t *self, const char *format, ...);
+void arena_reset(arena_t *self);
+void arena_delete(arena_t *self);
+
 typedef struct list_node_t {
     struct list_node_t *next;
     struct list_node_t *prev;
@@ -59,6 +98,7 @@ typedef struct list_node_t {
 typedef struct list_t {
     size_t size;
     size_t padding;
+    pool_t *pool;
     list_node_t *head;
     list_node_t *tail;
 } list_t;
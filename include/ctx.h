@@ -3,19 +3,27 @@
 
 #include "core.h"
 
+#define CTX_TICK_RATE 60
+
 struct audio_t;
 struct video_t;
+struct font_t;
 
 typedef struct sketch_t {
     void (*init)();
     void (*tick)();
-    void (*draw)(struct video_t*);
+    void (*draw)(struct video_t*, float);
     void (*shutdown)();
+    void (*advance)(double);
 } sketch_t;
 
 int ctx_main(int argc, char **argv, sketch_t *sketch);
 vec2_t ctx_viewport();
 struct audio_t *ctx_audio();
+struct video_t *ctx_video();
+arena_t *ctx_arena();
+arena_t *ctx_arena_next();
+void ctx_profiler_font(struct font_t *font);
 void ctx_hook_mouse(void (*hook)(vec2_t));
 
 #endif
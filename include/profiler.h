@@ -0,0 +1,28 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "video.h"
+
+#define PROFILER_HISTORY 240
+
+typedef enum {
+    PROFILER_EVENTS,
+    PROFILER_TICK,
+    PROFILER_DRAW,
+    PROFILER_SWAP,
+    PROFILER_PHASES
+} profiler_phase;
+
+struct profiler_t;
+typedef struct profiler_t profiler_t;
+
+profiler_t *profiler_new();
+void profiler_begin(profiler_t *self, profiler_phase phase);
+void profiler_end(profiler_t *self, profiler_phase phase);
+void profiler_gpu_begin(profiler_t *self);
+void profiler_gpu_end(profiler_t *self);
+void profiler_frame(profiler_t *self);
+void profiler_draw(profiler_t *self, video_t *video, font_t *font, float x, float y);
+void profiler_delete(profiler_t *self);
+
+#endif
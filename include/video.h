@@ -12,9 +12,30 @@ typedef enum {
 struct video_t;
 typedef struct video_t video_t;
 
+typedef struct video_stats_t {
+    size_t commands;
+    size_t draws;
+    size_t uploads;
+    size_t bytes;
+    size_t stalls;
+    size_t env_switches;
+    size_t binds;
+    size_t uniforms;
+    size_t memory;
+} video_stats_t;
+
+struct atlas_t;
+typedef struct atlas_t atlas_t;
+
+struct video_mesh_t;
+typedef struct video_mesh_t video_mesh_t;
+
 typedef struct sprite_t {
     unsigned int texture;
     int w, h;
+    int x, y;
+    int tex_w, tex_h;
+    atlas_t *atlas;
 } sprite_t;
 
 typedef struct glyph_t {
@@ -29,9 +50,42 @@ typedef struct font_t {
     glyph_t glyphs[128];
 } font_t;
 
+typedef struct text_t {
+    font_t *font;
+    float x, y;
+    float height;
+    char *str;
+    size_t length;
+    size_t capacity;
+    float *pens;
+    size_t *quads;
+    float *vertices;
+    uint32_t color;
+    unsigned int vbo;
+    size_t vbo_capacity;
+    size_t count;
+} text_t;
+
+typedef enum {
+    EMITTER_ARRAY,
+    EMITTER_SOA,
+    EMITTER_GPU
+} emitter_mode;
+
 typedef struct emitter_t {
+    emitter_mode mode;
     array_t *particles;
     sprite_t *sprite;
+    size_t size;
+    size_t capacity;
+    float *position;
+    float *velocity;
+    float *color;
+    int32_t *lifetime;
+    unsigned int vbo;
+    size_t head;
+    int time;
+    int expiry;
 } emitter_t;
 
 typedef struct particle_t {
@@ -39,14 +93,31 @@ typedef struct particle_t {
     vec4_t color;
     vec2_t velocity;
     int lifetime;
+    int spawn;
 } particle_t;
 
 video_t *video_new();
 void video_cfg_color(video_t *self, vec4_t color);
+void video_cfg_tint(video_t *self, vec4_t tint);
 void video_cfg_mode(video_t *self, video_mode mode);
+void video_cfg_deferred(video_t *self, bool deferred);
+void video_cfg_instanced(video_t *self, bool instanced);
+void video_push(video_t *self);
+void video_pop(video_t *self);
+void video_translate(video_t *self, float x, float y);
+void video_scale(video_t *self, float x, float y);
+void video_rotate(video_t *self, float angle);
 void video_clear(video_t *self);
 void video_rectangle(video_t *self, float x, float y, float w, float h);
 void video_triangle(video_t *self, float x0, float y0, float x1, float y1, float x2, float y2);
+void video_flush(video_t *self);
+video_stats_t video_stats(video_t *self);
+video_mesh_t *video_mesh_begin(video_t *self);
+void video_mesh_end(video_t *self, video_mesh_t *mesh);
+size_t video_mesh_elements(video_mesh_t *mesh);
+void video_mesh_color(video_mesh_t *mesh, size_t element, vec4_t color);
+void video_mesh_draw(video_t *self, video_mesh_t *mesh);
+void video_mesh_delete(video_mesh_t *mesh);
 void video_delete(video_t *self);
 
 sprite_t *sprite_load(const char *filename);
@@ -57,15 +128,33 @@ void video_sprite_item(video_t *self, vec4_t dst, vec4_t src);
 void video_sprite_end(video_t *self);
 void video_sprite(video_t *self, sprite_t *sprite, float x, float y);
 void video_sprite_ext(video_t *self, sprite_t *sprite, vec4_t dst, vec4_t src);
+bool sprite_ready(sprite_t *self);
 void sprite_delete(sprite_t *self);
 
+atlas_t *atlas_new(int w, int h);
+sprite_t *atlas_add(atlas_t *self, const char *filename);
+sprite_t *atlas_add_async(atlas_t *self, const char *filename);
+bool atlas_build(atlas_t *self);
+bool atlas_build_async(atlas_t *self);
+float atlas_progress(atlas_t *self);
+void atlas_delete(atlas_t *self);
+
 font_t *font_load(const char *filename_desc, const char *filename_sprite);
+font_t *font_load_atlas(atlas_t *atlas, const char *filename_desc, const char *filename_sprite);
+font_t *font_load_atlas_async(atlas_t *atlas, const char *filename_desc, const char *filename_sprite);
 void video_text(video_t *self, font_t *font, const char *str, float x, float y);
 void font_delete(font_t *self);
 
+text_t *text_new(font_t *font, float x, float y);
+void text_set(text_t *self, const char *str);
+void video_text_run(video_t *self, text_t *text);
+void text_delete(text_t *self);
+
 emitter_t *emitter_new(sprite_t *sprite);
+emitter_t *emitter_new_ext(sprite_t *sprite, emitter_mode mode);
 particle_t *emitter_emit(emitter_t *self, float x, float y);
 void emitter_tick(emitter_t *self);
+void emitter_tick_all(emitter_t **emitters, size_t count);
 void emitter_draw(emitter_t *self, struct video_t *video);
 void emitter_delete(emitter_t *self);
 
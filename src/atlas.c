@@ -0,0 +1,347 @@
+#include "video_private.h"
+
+#define ATLAS_PADDING 1
+
+typedef struct atlas_node_t {
+    int x, y, w;
+} atlas_node_t;
+
+typedef struct atlas_entry_t {
+    sprite_t *sprite;
+    SDL_Surface *surface;
+    size_t page;
+} atlas_entry_t;
+
+typedef struct atlas_load_t {
+    char *filename;
+    sprite_t *sprite;
+    SDL_Surface *surface;
+    SDL_atomic_t done;
+} atlas_load_t;
+
+typedef struct atlas_page_t {
+    GLuint texture;
+    int w, h;
+    array_t *skyline;
+    uint32_t *pixels;
+} atlas_page_t;
+
+struct atlas_t {
+    int w, h;
+    array_t *entries;
+    array_t *pages;
+    array_t *loads;
+    size_t uploaded;
+    size_t requested;
+    list_t *sprites;
+};
+
+static atlas_page_t *atlas_page_new(atlas_t *self, int w, int h) {
+    atlas_page_t *page = array_add_last(self->pages, NULL);
+    page->texture = 0;
+    page->w = w;
+    page->h = h;
+    page->skyline = array_new(sizeof(atlas_node_t));
+    atlas_node_t node = {0, 0, w};
+    array_add_last(page->skyline, &node);
+    page->pixels = malloc_ext((size_t) w * h * sizeof(uint32_t));
+    memset(page->pixels, 0, (size_t) w * h * sizeof(uint32_t));
+    return page;
+}
+
+static int atlas_page_fit(atlas_page_t *page, int index, int w, int h) {
+    atlas_node_t *node = array_get(page->skyline, index);
+    if (node->x + w > page->w) {
+        return -1;
+    }
+    int y = 0;
+    int remaining = w;
+    for (int i = index; remaining > 0; i++) {
+        node = array_get(page->skyline, i);
+        y = MAX(y, node->y);
+        if (y + h > page->h) {
+            return -1;
+        }
+        remaining -= node->w;
+    }
+    return y;
+}
+
+static bool atlas_page_insert(atlas_page_t *page, int w, int h, int *x, int *y) {
+    int best = -1;
+    int best_y = page->h;
+    int best_w = page->w + 1;
+    for (int i = 0; i < page->skyline->size; i++) {
+        atlas_node_t *node = array_get(page->skyline, i);
+        int fit = atlas_page_fit(page, i, w, h);
+        if (fit >= 0 && (fit + h < best_y || (fit + h == best_y && node->w < best_w))) {
+            best = i;
+            best_y = fit + h;
+            best_w = node->w;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+    atlas_node_t *node = array_get(page->skyline, best);
+    *x = node->x;
+    *y = best_y - h;
+    atlas_node_t next = {*x, best_y, w};
+    array_add(page->skyline, best, &next);
+    for (int i = best + 1; i < page->skyline->size;) {
+        atlas_node_t *prev = array_get(page->skyline, i - 1);
+        node = array_get(page->skyline, i);
+        int shrink = prev->x + prev->w - node->x;
+        if (shrink <= 0) {
+            break;
+        }
+        if (node->w > shrink) {
+            node->x += shrink;
+            node->w -= shrink;
+            break;
+        }
+        array_remove(page->skyline, i);
+    }
+    for (int i = 0; i + 1 < page->skyline->size;) {
+        atlas_node_t *prev = array_get(page->skyline, i);
+        node = array_get(page->skyline, i + 1);
+        if (prev->y == node->y) {
+            prev->w += node->w;
+            array_remove(page->skyline, i + 1);
+        } else {
+            i++;
+        }
+    }
+    return true;
+}
+
+static void atlas_page_blit(atlas_page_t *page, SDL_Surface *surface, int x, int y) {
+    for (int row = -ATLAS_PADDING; row < surface->h + ATLAS_PADDING; row++) {
+        int src_row = MIN(MAX(row, 0), surface->h - 1);
+        uint32_t *src = (uint32_t*) ((uint8_t*) surface->pixels + src_row * surface->pitch);
+        uint32_t *dst = page->pixels + (size_t) (y + row) * page->w + x;
+        for (int col = -ATLAS_PADDING; col < 0; col++) {
+            dst[col] = src[0];
+        }
+        memcpy(dst, src, surface->w * sizeof(uint32_t));
+        for (int col = surface->w; col < surface->w + ATLAS_PADDING; col++) {
+            dst[col] = src[surface->w - 1];
+        }
+    }
+}
+
+static int atlas_entry_compare(const void *a, const void *b) {
+    const atlas_entry_t *entry_a = a;
+    const atlas_entry_t *entry_b = b;
+    if (entry_a->surface->h != entry_b->surface->h) {
+        return entry_b->surface->h - entry_a->surface->h;
+    }
+    return entry_b->surface->w - entry_a->surface->w;
+}
+
+atlas_t *atlas_new(int w, int h) {
+    atlas_t *self = malloc_ext(sizeof(*self));
+    self->w = w;
+    self->h = h;
+    self->entries = array_new(sizeof(atlas_entry_t));
+    self->pages = array_new(sizeof(atlas_page_t));
+    self->loads = array_new(sizeof(atlas_load_t*));
+    self->uploaded = 0;
+    self->requested = 0;
+    self->sprites = list_new(sizeof(sprite_t));
+    return self;
+}
+
+static void atlas_entry_add(atlas_t *self, sprite_t *sprite, SDL_Surface *surface) {
+    sprite->w = surface->w;
+    sprite->h = surface->h;
+    atlas_entry_t *entry = array_add_last(self->entries, NULL);
+    entry->sprite = sprite;
+    entry->surface = surface;
+}
+
+static void atlas_load_run(void *userdata, size_t begin, size_t end) {
+    atlas_load_t *load = userdata;
+    load->surface = sprite_surface_load(load->filename);
+    SDL_AtomicSet(&load->done, 1);
+}
+
+static bool atlas_poll(atlas_t *self) {
+    iterator_t iterator = array_iterator(self->loads);
+    while (iterator_has_next(iterator)) {
+        atlas_load_t *load = *(atlas_load_t**) iterator_next(iterator);
+        if (!SDL_AtomicGet(&load->done)) {
+            return false;
+        }
+    }
+    iterator = array_iterator(self->loads);
+    while (iterator_has_next(iterator)) {
+        atlas_load_t *load = *(atlas_load_t**) iterator_next(iterator);
+        if (load->surface) {
+            atlas_entry_add(self, load->sprite, load->surface);
+        }
+#ifdef DEBUG
+        else {
+            printf("atlas_poll: failed to load %s\n", load->filename);
+        }
+#endif
+        free(load->filename);
+        free(load);
+    }
+    self->loads->size = 0;
+    return true;
+}
+
+sprite_t *atlas_add(atlas_t *self, const char *filename) {
+    SDL_Surface *surface = sprite_surface_load(filename);
+    if (!surface) {
+        return NULL;
+    }
+    sprite_t *sprite = list_add_last(self->sprites, NULL);
+    memset(sprite, 0, sizeof(*sprite));
+    sprite->atlas = self;
+    atlas_entry_add(self, sprite, surface);
+    self->requested++;
+    return sprite;
+}
+
+sprite_t *atlas_add_async(atlas_t *self, const char *filename) {
+    sprite_t *sprite = list_add_last(self->sprites, NULL);
+    memset(sprite, 0, sizeof(*sprite));
+    sprite->atlas = self;
+    atlas_load_t *load = malloc_ext(sizeof(*load));
+    load->filename = malloc_ext(strlen(filename) + 1);
+    strcpy(load->filename, filename);
+    load->sprite = sprite;
+    load->surface = NULL;
+    SDL_AtomicSet(&load->done, 0);
+    array_add_last(self->loads, &load);
+    self->requested++;
+    job_submit(atlas_load_run, load);
+    return sprite;
+}
+
+static void atlas_pack(atlas_t *self) {
+    qsort(self->entries->data, self->entries->size, self->entries->padding, atlas_entry_compare);
+    size_t first_page = self->pages->size;
+    iterator_t iterator = array_iterator(self->entries);
+    while (iterator_has_next(iterator)) {
+        atlas_entry_t *entry = iterator_next(iterator);
+        int w = entry->surface->w + 2 * ATLAS_PADDING;
+        int h = entry->surface->h + 2 * ATLAS_PADDING;
+        int x, y;
+        atlas_page_t *page = NULL;
+        for (size_t i = first_page; i < self->pages->size; i++) {
+            atlas_page_t *candidate = array_get(self->pages, (int) i);
+            if (atlas_page_insert(candidate, w, h, &x, &y)) {
+                page = candidate;
+                break;
+            }
+        }
+        if (!page) {
+            page = atlas_page_new(self, MAX(self->w, w), MAX(self->h, h));
+            atlas_page_insert(page, w, h, &x, &y);
+        }
+        atlas_page_blit(page, entry->surface, x + ATLAS_PADDING, y + ATLAS_PADDING);
+        entry->sprite->x = x + ATLAS_PADDING;
+        entry->sprite->y = y + ATLAS_PADDING;
+        entry->sprite->tex_w = page->w;
+        entry->sprite->tex_h = page->h;
+        entry->page = (size_t) (page - (atlas_page_t*) self->pages->data);
+        SDL_FreeSurface(entry->surface);
+        entry->surface = NULL;
+    }
+}
+
+static void atlas_upload(atlas_t *self) {
+    atlas_page_t *page = array_get(self->pages, (int) self->uploaded);
+    glGenTextures(1, &page->texture);
+    glBindTexture(GL_TEXTURE_2D, page->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page->w, page->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, page->pixels);
+    sprite_texture_params();
+    free(page->pixels);
+    page->pixels = NULL;
+    self->uploaded++;
+}
+
+static void atlas_finish(atlas_t *self) {
+    iterator_t iterator = array_iterator(self->entries);
+    while (iterator_has_next(iterator)) {
+        atlas_entry_t *entry = iterator_next(iterator);
+        atlas_page_t *page = array_get(self->pages, (int) entry->page);
+        entry->sprite->texture = page->texture;
+    }
+    self->entries->size = 0;
+}
+
+bool atlas_build(atlas_t *self) {
+    while (!atlas_poll(self)) {
+        SDL_Delay(1);
+    }
+    size_t packed = self->entries->size;
+    if (packed && self->uploaded == self->pages->size) {
+        atlas_pack(self);
+    }
+    while (self->uploaded < self->pages->size) {
+        atlas_upload(self);
+    }
+    atlas_finish(self);
+    return packed > 0;
+}
+
+bool atlas_build_async(atlas_t *self) {
+    if (!atlas_poll(self)) {
+        return false;
+    }
+    if (self->entries->size && self->uploaded == self->pages->size) {
+        atlas_pack(self);
+        return false;
+    }
+    if (self->uploaded < self->pages->size) {
+        atlas_upload(self);
+        if (self->uploaded < self->pages->size) {
+            return false;
+        }
+    }
+    atlas_finish(self);
+    return true;
+}
+
+float atlas_progress(atlas_t *self) {
+    size_t done = 0;
+    iterator_t iterator = array_iterator(self->loads);
+    while (iterator_has_next(iterator)) {
+        atlas_load_t *load = *(atlas_load_t**) iterator_next(iterator);
+        done += SDL_AtomicGet(&load->done) ? 1 : 0;
+    }
+    size_t decoded = self->requested - (self->loads->size - done);
+    float decode = self->requested ? (float) decoded / self->requested : 1.0f;
+    float upload = 0.0f;
+    if (!self->loads->size && (!self->entries->size || self->uploaded < self->pages->size)) {
+        upload = self->pages->size ? (float) self->uploaded / self->pages->size : 1.0f;
+    }
+    return 0.5f * decode + 0.5f * upload;
+}
+
+void atlas_delete(atlas_t *self) {
+    while (!atlas_poll(self)) {
+        SDL_Delay(1);
+    }
+    iterator_t iterator = array_iterator(self->entries);
+    while (iterator_has_next(iterator)) {
+        atlas_entry_t *entry = iterator_next(iterator);
+        SDL_FreeSurface(entry->surface);
+    }
+    iterator = array_iterator(self->pages);
+    while (iterator_has_next(iterator)) {
+        atlas_page_t *page = iterator_next(iterator);
+        glDeleteTextures(1, &page->texture);
+        array_delete(page->skyline);
+        free(page->pixels);
+    }
+    array_delete(self->entries);
+    array_delete(self->pages);
+    array_delete(self->loads);
+    list_delete(self->sprites);
+    free(self);
+}
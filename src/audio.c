@@ -3,19 +3,109 @@
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define AUDIO_QUEUE_SIZE 256
+#define AUDIO_VOICES 256
+#define AUDIO_PAN_QUARTER 0.78539816f
+#define AUDIO_PAN_SQRT2 1.41421356f
+#define AUDIO_STREAM_RING 65536
+#define AUDIO_STREAM_CHUNK 4096
+#define AUDIO_STREAM_POLL 10
+#define AUDIO_SAMPLES_DEFAULT 4096
+#define AUDIO_SAMPLES_LOW 256
+#define AUDIO_SAMPLES_MAX 8192
+#define AUDIO_WARMUP 8
+#define AUDIO_UNDERRUN_LIMIT 2
+#define AUDIO_UNDERRUN_WINDOW 2000
+#define AUDIO_BENCH_CALLBACKS 1000
+#define AUDIO_BENCH_TIMEOUT 30000
 
-typedef struct audio_handle_t {
+typedef enum {
+    AUDIO_PLAY,
+    AUDIO_STOP,
+    AUDIO_VOLUME
+} audio_cmd_type;
+
+typedef struct audio_cmd_t {
+    audio_cmd_type type;
+    sound_t *sound;
+    float volume;
+    float pan;
+} audio_cmd_t;
+
+typedef struct audio_voice_t {
     sound_t *sound;
     uint32_t offset;
-} audio_handle_t;
+    uint32_t serial;
+    float gain;
+    float gain_l;
+    float gain_r;
+} audio_voice_t;
+
+struct audio_load_t {
+    sound_t *sound;
+    char *filename;
+    SDL_AudioSpec target;
+    uint8_t *buffer;
+    uint32_t buffer_size;
+    SDL_atomic_t done;
+};
+
+struct audio_stream_t {
+    audio_t *audio;
+    SDL_RWops *file;
+    SDL_AudioStream *convert;
+    Sint64 data_start;
+    uint32_t data_size;
+    uint32_t data_read;
+    uint32_t frame_size;
+    bool drained;
+    bool dirty;
+    uint8_t chunk[AUDIO_STREAM_CHUNK];
+    float ring[AUDIO_STREAM_RING];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t request;
+    SDL_atomic_t ack;
+    SDL_atomic_t eof;
+};
 
 struct audio_t {
-    array_t *handles;
+    audio_voice_t voices[AUDIO_VOICES];
+    uint32_t serial;
+    float volume;
+    audio_cmd_t queue[AUDIO_QUEUE_SIZE];
+    SDL_atomic_t queue_head;
+    SDL_atomic_t queue_tail;
+    SDL_atomic_t queue_peak;
+    SDL_atomic_t dropped;
+    array_t *streams;
+    array_t *loads;
+    SDL_mutex *stream_lock;
+    SDL_Thread *loader;
+    SDL_atomic_t loader_quit;
+    audio_latency latency;
+    int period;
+    int callback_count;
+    Uint64 callback_last;
+    SDL_atomic_t callback_total;
+    SDL_atomic_t callback_peak;
+    SDL_atomic_t callbacks;
+    SDL_atomic_t underruns;
+    int underruns_seen;
+    Uint32 underruns_window;
     SDL_AudioSpec desired;
     SDL_AudioSpec obtained;
     SDL_AudioDeviceID device;
 };
 
+static pool_t *sound_pool;
+
 #ifdef __EMSCRIPTEN__
 static int audio_apple_fix(void *userdata, SDL_Event *event) {
     int audio_started;
@@ -47,84 +137,732 @@ static int audio_apple_fix(void *userdata, SDL_Event *event) {
 }
 #endif
 
+static bool audio_queue_push(audio_t *self, audio_cmd_t *cmd) {
+    unsigned int head = (unsigned int) SDL_AtomicGet(&self->queue_head);
+    int depth = (int) (head - (unsigned int) SDL_AtomicGet(&self->queue_tail));
+    if (depth >= AUDIO_QUEUE_SIZE) {
+        SDL_AtomicAdd(&self->dropped, 1);
+        return false;
+    }
+    self->queue[head % AUDIO_QUEUE_SIZE] = *cmd;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&self->queue_head, (int) (head + 1));
+    if (depth + 1 > SDL_AtomicGet(&self->queue_peak)) {
+        SDL_AtomicSet(&self->queue_peak, depth + 1);
+    }
+    return true;
+}
+
+static bool audio_voice_quieter(audio_voice_t *a, audio_voice_t *b, audio_steal steal) {
+    if (steal == AUDIO_STEAL_QUIETEST && a->gain != b->gain) {
+        return a->gain < b->gain;
+    }
+    return (int32_t) (a->serial - b->serial) < 0;
+}
+
+static audio_voice_t *audio_voice_alloc(audio_t *self, sound_t *sound) {
+    audio_voice_t *free_voice = NULL;
+    audio_voice_t *victim = NULL;
+    audio_voice_t *victim_sound = NULL;
+    int count = 0;
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        audio_voice_t *voice = &self->voices[i];
+        if (!voice->sound) {
+            free_voice = free_voice ? free_voice : voice;
+            continue;
+        }
+        if (!victim || audio_voice_quieter(voice, victim, sound->steal)) {
+            victim = voice;
+        }
+        if (voice->sound == sound) {
+            count++;
+            if (!victim_sound || audio_voice_quieter(voice, victim_sound, sound->steal)) {
+                victim_sound = voice;
+            }
+        }
+    }
+    if (count >= sound->polyphony) {
+        return victim_sound;
+    }
+    return free_voice ? free_voice : victim;
+}
+
+static void audio_voice_start(audio_t *self, audio_cmd_t *cmd) {
+    if (cmd->sound->polyphony <= 0) {
+        return;
+    }
+    audio_stream_t *stream = cmd->sound->stream;
+    if (stream && stream->dirty) {
+        stream->dirty = false;
+        SDL_AtomicAdd(&stream->request, 1);
+    }
+    audio_voice_t *voice = audio_voice_alloc(self, cmd->sound);
+    float angle = (MIN(MAX(cmd->pan, -1.0f), 1.0f) + 1.0f) * AUDIO_PAN_QUARTER;
+    voice->sound = cmd->sound;
+    voice->offset = 0;
+    voice->serial = self->serial++;
+    voice->gain = cmd->volume;
+    voice->gain_l = cmd->volume * cosf(angle) * AUDIO_PAN_SQRT2;
+    voice->gain_r = cmd->volume * sinf(angle) * AUDIO_PAN_SQRT2;
+}
+
+static void audio_voice_stop(audio_t *self, sound_t *sound) {
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if (self->voices[i].sound == sound) {
+            self->voices[i].sound = NULL;
+        }
+    }
+}
+
+static void audio_mix(float *dst, const float *src, size_t count, float gain_l, float gain_r) {
+    size_t i = 0;
+#if defined(__AVX__)
+    __m256 gain8 = _mm256_setr_ps(gain_l, gain_r, gain_l, gain_r, gain_l, gain_r, gain_l, gain_r);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), gain8)));
+    }
+#endif
+#if defined(__AVX__) || defined(__SSE__)
+    __m128 gain4 = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), gain4)));
+    }
+#endif
+    for (; i + 2 <= count; i += 2) {
+        dst[i] += src[i] * gain_l;
+        dst[i + 1] += src[i + 1] * gain_r;
+    }
+}
+
+static void audio_mix_stream(audio_t *self, audio_voice_t *voice, float *dst, uint32_t samples) {
+    audio_stream_t *stream = voice->sound->stream;
+    if (SDL_AtomicGet(&stream->ack) != SDL_AtomicGet(&stream->request)) {
+        return;
+    }
+    int eof = SDL_AtomicGet(&stream->eof);
+    unsigned int head = (unsigned int) SDL_AtomicGet(&stream->head);
+    unsigned int tail = (unsigned int) SDL_AtomicGet(&stream->tail);
+    SDL_MemoryBarrierAcquire();
+    uint32_t count = MIN(head - tail, samples);
+    for (uint32_t mixed = 0; mixed < count;) {
+        unsigned int index = (tail + mixed) & (AUDIO_STREAM_RING - 1);
+        uint32_t run = MIN(count - mixed, AUDIO_STREAM_RING - index);
+        audio_mix(dst + mixed, stream->ring + index, run, self->volume * voice->gain_l, self->volume * voice->gain_r);
+        mixed += run;
+    }
+    if (count) {
+        stream->dirty = true;
+        SDL_AtomicSet(&stream->tail, (int) (tail + count));
+    }
+    if (eof && tail + count == head) {
+        voice->sound = NULL;
+    }
+}
+
+static void audio_clamp(float *dst, size_t count) {
+    size_t i = 0;
+#if defined(__AVX__) || defined(__SSE__)
+    __m128 min4 = _mm_set1_ps(-1.0f);
+    __m128 max4 = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(dst + i), min4), max4));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = MIN(MAX(dst[i], -1.0f), 1.0f);
+    }
+}
+
+static void audio_queue_drain(audio_t *self) {
+    unsigned int tail = (unsigned int) SDL_AtomicGet(&self->queue_tail);
+    unsigned int head = (unsigned int) SDL_AtomicGet(&self->queue_head);
+    SDL_MemoryBarrierAcquire();
+    for (; tail != head; tail++) {
+        audio_cmd_t *cmd = &self->queue[tail % AUDIO_QUEUE_SIZE];
+        switch (cmd->type) {
+            case AUDIO_PLAY:
+                audio_voice_start(self, cmd);
+                break;
+            case AUDIO_STOP:
+                audio_voice_stop(self, cmd->sound);
+                break;
+            case AUDIO_VOLUME:
+                self->volume = cmd->volume;
+                break;
+        }
+    }
+    SDL_AtomicSet(&self->queue_tail, (int) tail);
+}
+
+static void audio_stream_read(audio_stream_t *self) {
+    uint32_t size = MIN(AUDIO_STREAM_CHUNK, self->data_size - self->data_read);
+    size -= size % self->frame_size;
+    size_t count = size ? SDL_RWread(self->file, self->chunk, 1, size) : 0;
+    count -= count % self->frame_size;
+    if (count) {
+        SDL_AudioStreamPut(self->convert, self->chunk, (int) count);
+        self->data_read += (uint32_t) count;
+    }
+    if (!count || self->data_read >= self->data_size) {
+        SDL_AudioStreamFlush(self->convert);
+        self->drained = true;
+    }
+}
+
+static void audio_stream_pump(audio_stream_t *self) {
+    int request = SDL_AtomicGet(&self->request);
+    if (request != SDL_AtomicGet(&self->ack)) {
+        SDL_RWseek(self->file, self->data_start, RW_SEEK_SET);
+        SDL_AudioStreamClear(self->convert);
+        self->data_read = 0;
+        self->drained = false;
+        SDL_AtomicSet(&self->eof, 0);
+        SDL_AtomicSet(&self->head, SDL_AtomicGet(&self->tail));
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&self->ack, request);
+    }
+    unsigned int head = (unsigned int) SDL_AtomicGet(&self->head);
+    for (;;) {
+        unsigned int space = AUDIO_STREAM_RING - (head - (unsigned int) SDL_AtomicGet(&self->tail));
+        if (!space) {
+            break;
+        }
+        if (!self->drained && SDL_AudioStreamAvailable(self->convert) < AUDIO_STREAM_CHUNK) {
+            audio_stream_read(self);
+            continue;
+        }
+        unsigned int index = head & (AUDIO_STREAM_RING - 1);
+        int size = SDL_AudioStreamGet(self->convert, self->ring + index, (int) (MIN(space, AUDIO_STREAM_RING - index) * sizeof(float)));
+        if (size <= 0) {
+            if (self->drained) {
+                SDL_AtomicSet(&self->eof, 1);
+            }
+            break;
+        }
+        head += (unsigned int) size / sizeof(float);
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&self->head, (int) head);
+    }
+}
+
+#ifndef __EMSCRIPTEN__
+static int audio_loader(void *userdata) {
+    audio_t *self = userdata;
+    while (!SDL_AtomicGet(&self->loader_quit)) {
+        SDL_LockMutex(self->stream_lock);
+        iterator_t iterator = array_iterator(self->streams);
+        while (iterator_has_next(iterator)) {
+            audio_stream_pump(*(audio_stream_t**) iterator_next(iterator));
+        }
+        SDL_UnlockMutex(self->stream_lock);
+        SDL_Delay(AUDIO_STREAM_POLL);
+    }
+    return 0;
+}
+#endif
+
+static void audio_measure(audio_t *self, Uint64 start, Uint64 end) {
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    int duration = (int) ((end - start) * 1000000 / frequency);
+    if (self->callback_count > AUDIO_WARMUP) {
+        int interval = (int) ((start - self->callback_last) * 1000000 / frequency);
+        if (interval > 2 * self->period || duration > self->period) {
+            SDL_AtomicAdd(&self->underruns, 1);
+        }
+    }
+    self->callback_last = start;
+    self->callback_count++;
+    SDL_AtomicAdd(&self->callback_total, duration);
+    SDL_AtomicAdd(&self->callbacks, 1);
+    if (duration > SDL_AtomicGet(&self->callback_peak)) {
+        SDL_AtomicSet(&self->callback_peak, duration);
+    }
+}
+
 static void audio_callback(void *userdata, uint8_t *stream, int32_t len) {
     audio_t *self = userdata;
-    iterator_t iterator = array_iterator(self->handles);
-    memset(stream, 0, (size_t) len);
+    Uint64 start = SDL_GetPerformanceCounter();
+    audio_queue_drain(self);
+#ifdef __EMSCRIPTEN__
+    iterator_t iterator = array_iterator(self->streams);
     while (iterator_has_next(iterator)) {
-        audio_handle_t *handle = iterator_next(iterator);
-        if (handle->offset < handle->sound->buffer_size) {
-            uint8_t *src = handle->sound->buffer + handle->offset;
-            uint32_t count = MIN(handle->sound->buffer_size - handle->offset, (uint32_t) len);
-            SDL_MixAudioFormat(stream, src, self->obtained.format, count, SDL_MIX_MAXVOLUME);
-            handle->offset += count;
-        } else {
-            iterator_remove(iterator);
+        audio_stream_pump(*(audio_stream_t**) iterator_next(iterator));
+    }
+#endif
+    float *dst = (float*) stream;
+    uint32_t samples = (uint32_t) len / sizeof(float);
+    memset(stream, 0, (size_t) len);
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        audio_voice_t *voice = &self->voices[i];
+        if (!voice->sound) {
+            continue;
+        }
+        if (voice->sound->stream) {
+            audio_mix_stream(self, voice, dst, samples);
+            continue;
+        }
+        uint32_t total = voice->sound->buffer_size / sizeof(float);
+        uint32_t count = MIN(total - voice->offset, samples);
+        const float *src = (const float*) voice->sound->buffer + voice->offset;
+        audio_mix(dst, src, count, self->volume * voice->gain_l, self->volume * voice->gain_r);
+        voice->offset += count;
+        if (voice->offset >= total) {
+            voice->sound = NULL;
         }
     }
+    audio_clamp(dst, samples);
+    audio_measure(self, start, SDL_GetPerformanceCounter());
+}
+
+static bool audio_open(audio_t *self, int samples, int allowed) {
+    self->desired.samples = (Uint16) samples;
+    self->device = SDL_OpenAudioDevice(NULL, 0, &self->desired, &self->obtained, allowed);
+    if (!self->device) {
+        return false;
+    }
+    self->period = (int) ((int64_t) self->obtained.samples * 1000000 / self->obtained.freq);
+    self->callback_count = 0;
+    self->callback_last = 0;
+    SDL_AtomicSet(&self->callback_total, 0);
+    SDL_AtomicSet(&self->callback_peak, 0);
+    SDL_AtomicSet(&self->callbacks, 0);
+    self->underruns_seen = SDL_AtomicGet(&self->underruns);
+    self->underruns_window = SDL_GetTicks();
+    SDL_PauseAudioDevice(self->device, 0);
+    return true;
 }
 
 audio_t *audio_new() {
-#ifdef __EMSCRIPTEN__
-    SDL_SetEventFilter(audio_apple_fix, NULL);
-#endif
+    return audio_new_ext(AUDIO_LATENCY_DEFAULT);
+}
+
+static audio_t *audio_alloc(audio_latency latency) {
     audio_t *self = malloc_ext(sizeof(*self));
+    memset(self->voices, 0, sizeof(self->voices));
+    self->serial = 0;
+    self->volume = 1.0f;
+    SDL_AtomicSet(&self->queue_head, 0);
+    SDL_AtomicSet(&self->queue_tail, 0);
+    SDL_AtomicSet(&self->queue_peak, 0);
+    SDL_AtomicSet(&self->dropped, 0);
+    self->streams = array_new(sizeof(audio_stream_t*));
+    self->loads = array_new(sizeof(audio_load_t*));
+    self->stream_lock = SDL_CreateMutex();
+    self->loader = NULL;
+    SDL_AtomicSet(&self->loader_quit, 0);
+    self->latency = latency;
+    SDL_AtomicSet(&self->underruns, 0);
     self->desired = (SDL_AudioSpec) {
             .freq = 44100,
             .format = AUDIO_F32,
             .channels = 2,
-            .samples = 4096,
             .callback = audio_callback,
             .userdata = self
     };
-    self->device = SDL_OpenAudioDevice(NULL, 0, &self->desired, &self->obtained, SDL_AUDIO_ALLOW_ANY_CHANGE);
-    if (!self->device) {
+    return self;
+}
+
+static void audio_free(audio_t *self) {
+    array_delete(self->streams);
+    array_delete(self->loads);
+    SDL_DestroyMutex(self->stream_lock);
+    free(self);
+}
+
+audio_t *audio_new_ext(audio_latency latency) {
+#ifdef __EMSCRIPTEN__
+    SDL_SetEventFilter(audio_apple_fix, NULL);
+#endif
+    audio_t *self = audio_alloc(latency);
+    int samples = latency == AUDIO_LATENCY_LOW ? AUDIO_SAMPLES_LOW : AUDIO_SAMPLES_DEFAULT;
+    if (!audio_open(self, samples, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE)) {
 #ifdef DEBUG
         printf("audio_new: failed to open audio device\n");
 #endif
-        free(self);
+        audio_free(self);
         return NULL;
     }
-    self->handles = array_new(sizeof(audio_handle_t));
-    SDL_PauseAudioDevice(self->device, 0);
+    self->desired.freq = self->obtained.freq;
     return self;
 }
 
-sound_t *audio_load_sound(audio_t *self, const char *filename) {
-    sound_t *sound = malloc_ext(sizeof(*sound));
+static void audio_load_poll(audio_t *self) {
+    for (int i = 0; i < self->loads->size;) {
+        audio_load_t *load = *(audio_load_t**) array_get(self->loads, i);
+        if (!SDL_AtomicGet(&load->done)) {
+            i++;
+            continue;
+        }
+#ifdef DEBUG
+        if (!load->buffer) {
+            printf("audio_load_poll: failed to load %s\n", load->filename);
+        }
+#endif
+        if (load->sound) {
+            load->sound->buffer_size = load->buffer_size;
+            load->sound->buffer = load->buffer;
+            load->sound->load = NULL;
+        } else {
+            free(load->buffer);
+        }
+        free(load->filename);
+        free(load);
+        array_remove_swap(self->loads, i);
+    }
+}
+
+void audio_update(audio_t *self) {
+    audio_load_poll(self);
+    if (self->latency != AUDIO_LATENCY_LOW) {
+        return;
+    }
+    int underruns = SDL_AtomicGet(&self->underruns);
+    Uint32 now = SDL_GetTicks();
+    if (underruns - self->underruns_seen >= AUDIO_UNDERRUN_LIMIT && self->obtained.samples < AUDIO_SAMPLES_MAX) {
+        int samples = self->obtained.samples * 2;
+        SDL_CloseAudioDevice(self->device);
+        if (!audio_open(self, samples, SDL_AUDIO_ALLOW_SAMPLES_CHANGE)) {
+#ifdef DEBUG
+            printf("audio_update: failed to reopen audio device\n");
+#endif
+            self->latency = AUDIO_LATENCY_DEFAULT;
+            return;
+        }
+    } else if (now - self->underruns_window >= AUDIO_UNDERRUN_WINDOW) {
+        self->underruns_seen = underruns;
+        self->underruns_window = now;
+    }
+}
+
+static void audio_sound_free(sound_t *sound) {
+    pool_free(sound_pool, sound);
+    if (!sound_pool->size) {
+        pool_delete(sound_pool);
+        sound_pool = NULL;
+    }
+}
+
+static uint8_t *audio_decode(const char *filename, const SDL_AudioSpec *target, uint32_t *size) {
     SDL_AudioSpec loaded;
-    if (!SDL_LoadWAV(filename, &loaded, &sound->buffer, &sound->buffer_size)) {
-        free(sound);
+    uint8_t *wav;
+    uint32_t wav_size;
+    if (!SDL_LoadWAV(filename, &loaded, &wav, &wav_size)) {
         return NULL;
     }
     SDL_AudioCVT cvt;
-    SDL_BuildAudioCVT(&cvt, loaded.format, loaded.channels, loaded.freq, self->obtained.format, self->obtained.channels, self->obtained.freq);
-    cvt.len = sound->buffer_size;
+    SDL_BuildAudioCVT(&cvt, loaded.format, loaded.channels, loaded.freq, target->format, target->channels, target->freq);
+    cvt.len = wav_size;
     cvt.buf = malloc_ext((size_t) (cvt.len * cvt.len_mult));
-    memcpy(cvt.buf, sound->buffer, sound->buffer_size);
+    memcpy(cvt.buf, wav, wav_size);
     SDL_ConvertAudio(&cvt);
-    SDL_FreeWAV(sound->buffer);
-    sound->buffer = cvt.buf;
-    sound->buffer_size = (uint32_t) cvt.len_cvt;
+    SDL_FreeWAV(wav);
+    *size = (uint32_t) cvt.len_cvt;
+    return cvt.buf;
+}
+
+static sound_t *audio_sound_new(audio_t *self) {
+    if (!sound_pool) {
+        sound_pool = pool_new(sizeof(sound_t));
+    }
+    sound_t *sound = pool_alloc(sound_pool);
+    sound->audio = self;
+    sound->buffer = NULL;
+    sound->buffer_size = 0;
+    sound->polyphony = AUDIO_VOICES;
+    sound->steal = AUDIO_STEAL_OLDEST;
+    sound->stream = NULL;
+    sound->load = NULL;
+    return sound;
+}
+
+sound_t *audio_load_sound(audio_t *self, const char *filename) {
+    if (!self) {
+        return NULL;
+    }
+    sound_t *sound = audio_sound_new(self);
+    sound->buffer = audio_decode(filename, &self->obtained, &sound->buffer_size);
+    if (!sound->buffer) {
+        audio_sound_free(sound);
+        return NULL;
+    }
+    return sound;
+}
+
+static void audio_load_run(void *userdata, size_t begin, size_t end) {
+    audio_load_t *load = userdata;
+    load->buffer = audio_decode(load->filename, &load->target, &load->buffer_size);
+    SDL_AtomicSet(&load->done, 1);
+}
+
+sound_t *audio_load_sound_async(audio_t *self, const char *filename) {
+    if (!self) {
+        return NULL;
+    }
+    sound_t *sound = audio_sound_new(self);
+    audio_load_t *load = malloc_ext(sizeof(*load));
+    load->sound = sound;
+    load->filename = malloc_ext(strlen(filename) + 1);
+    strcpy(load->filename, filename);
+    load->target = self->obtained;
+    load->buffer = NULL;
+    load->buffer_size = 0;
+    SDL_AtomicSet(&load->done, 0);
+    array_add_last(self->loads, &load);
+    sound->load = load;
+    job_submit(audio_load_run, load);
+    return sound;
+}
+
+bool audio_sound_ready(sound_t *sound) {
+    return sound->buffer || sound->stream;
+}
+
+static bool audio_stream_open(audio_stream_t *self, const char *filename, SDL_AudioSpec *spec) {
+    self->file = SDL_RWFromFile(filename, "rb");
+    if (!self->file) {
+        return false;
+    }
+    char id[4];
+    if (SDL_RWread(self->file, id, 1, 4) != 4 || memcmp(id, "RIFF", 4)) {
+        return false;
+    }
+    SDL_ReadLE32(self->file);
+    if (SDL_RWread(self->file, id, 1, 4) != 4 || memcmp(id, "WAVE", 4)) {
+        return false;
+    }
+    uint16_t tag = 0;
+    uint16_t bits = 0;
+    while (SDL_RWread(self->file, id, 1, 4) == 4) {
+        uint32_t size = SDL_ReadLE32(self->file);
+        Sint64 next = SDL_RWtell(self->file) + size + (size & 1);
+        if (!memcmp(id, "fmt ", 4) && size >= 16) {
+            tag = SDL_ReadLE16(self->file);
+            spec->channels = (uint8_t) SDL_ReadLE16(self->file);
+            spec->freq = (int) SDL_ReadLE32(self->file);
+            SDL_ReadLE32(self->file);
+            SDL_ReadLE16(self->file);
+            bits = SDL_ReadLE16(self->file);
+        } else if (!memcmp(id, "data", 4)) {
+            if (tag == 1 && bits == 8) {
+                spec->format = AUDIO_U8;
+            } else if (tag == 1 && bits == 16) {
+                spec->format = AUDIO_S16LSB;
+            } else if (tag == 1 && bits == 32) {
+                spec->format = AUDIO_S32LSB;
+            } else if (tag == 3 && bits == 32) {
+                spec->format = AUDIO_F32LSB;
+            } else {
+                return false;
+            }
+            self->data_start = SDL_RWtell(self->file);
+            self->data_size = size;
+            self->frame_size = (uint32_t) spec->channels * bits / 8;
+            return spec->channels > 0;
+        }
+        SDL_RWseek(self->file, next, RW_SEEK_SET);
+    }
+    return false;
+}
+
+static void audio_stream_delete(audio_stream_t *self) {
+    if (self->convert) {
+        SDL_FreeAudioStream(self->convert);
+    }
+    if (self->file) {
+        SDL_RWclose(self->file);
+    }
+    free(self);
+}
+
+sound_t *audio_load_stream(audio_t *self, const char *filename) {
+    audio_stream_t *stream = malloc_ext(sizeof(*stream));
+    stream->audio = self;
+    stream->convert = NULL;
+    stream->data_read = 0;
+    stream->drained = false;
+    stream->dirty = false;
+    SDL_AtomicSet(&stream->head, 0);
+    SDL_AtomicSet(&stream->tail, 0);
+    SDL_AtomicSet(&stream->request, 0);
+    SDL_AtomicSet(&stream->ack, 0);
+    SDL_AtomicSet(&stream->eof, 0);
+    SDL_AudioSpec spec;
+    if (!audio_stream_open(stream, filename, &spec)) {
+#ifdef DEBUG
+        printf("audio_load_stream: failed to open %s\n", filename);
+#endif
+        audio_stream_delete(stream);
+        return NULL;
+    }
+    stream->convert = SDL_NewAudioStream(spec.format, spec.channels, spec.freq, self->obtained.format, self->obtained.channels, self->obtained.freq);
+    if (!stream->convert) {
+#ifdef DEBUG
+        printf("audio_load_stream: failed to create converter for %s\n", filename);
+#endif
+        audio_stream_delete(stream);
+        return NULL;
+    }
+    SDL_RWseek(stream->file, stream->data_start, RW_SEEK_SET);
+    audio_stream_pump(stream);
+    sound_t *sound = audio_sound_new(self);
+    sound->polyphony = 1;
+    sound->stream = stream;
+    SDL_LockMutex(self->stream_lock);
+    array_add_last(self->streams, &stream);
+    SDL_UnlockMutex(self->stream_lock);
+#ifndef __EMSCRIPTEN__
+    if (!self->loader) {
+        self->loader = SDL_CreateThread(audio_loader, "audio_loader", self);
+    }
+#endif
     return sound;
 }
 
 void audio_sound_play(audio_t *self, sound_t *sound) {
-    SDL_LockAudioDevice(self->device);
-    audio_handle_t *handle = array_add_last(self->handles, NULL);
-    handle->sound = sound;
-    handle->offset = 0;
-    SDL_UnlockAudioDevice(self->device);
+    audio_sound_play_ext(self, sound, 1.0f, 0.0f);
+}
+
+void audio_sound_play_ext(audio_t *self, sound_t *sound, float gain, float pan) {
+    if (!audio_sound_ready(sound)) {
+        return;
+    }
+    audio_cmd_t cmd = {AUDIO_PLAY, sound, gain, pan};
+    audio_queue_push(self, &cmd);
+}
+
+void audio_sound_stop(audio_t *self, sound_t *sound) {
+    audio_cmd_t cmd = {AUDIO_STOP, sound, 0, 0};
+    audio_queue_push(self, &cmd);
+}
+
+void audio_volume(audio_t *self, float volume) {
+    audio_cmd_t cmd = {AUDIO_VOLUME, NULL, volume, 0};
+    audio_queue_push(self, &cmd);
+}
+
+audio_stats_t audio_stats(audio_t *self) {
+    return (audio_stats_t) {
+            .queue_depth = (int) ((unsigned int) SDL_AtomicGet(&self->queue_head) - (unsigned int) SDL_AtomicGet(&self->queue_tail)),
+            .queue_peak = SDL_AtomicGet(&self->queue_peak),
+            .dropped = SDL_AtomicGet(&self->dropped),
+            .samples = self->obtained.samples,
+            .latency = self->obtained.samples * 1000.0f / self->obtained.freq,
+            .underruns = SDL_AtomicGet(&self->underruns),
+            .callback_mean = SDL_AtomicGet(&self->callbacks) ? SDL_AtomicGet(&self->callback_total) / 1000.0f / SDL_AtomicGet(&self->callbacks) : 0.0f,
+            .callback_peak = SDL_AtomicGet(&self->callback_peak) / 1000.0f
+    };
 }
 
 void audio_sound_delete(sound_t *sound) {
-    SDL_FreeWAV(sound->buffer);
-    free(sound);
+    audio_t *audio = sound->audio;
+    SDL_LockAudioDevice(audio->device);
+    audio_queue_drain(audio);
+    audio_voice_stop(audio, sound);
+    SDL_UnlockAudioDevice(audio->device);
+    if (sound->load) {
+        sound->load->sound = NULL;
+    }
+    if (sound->stream) {
+        SDL_LockMutex(audio->stream_lock);
+        for (int i = 0; i < audio->streams->size; i++) {
+            if (*(audio_stream_t**) array_get(audio->streams, i) == sound->stream) {
+                array_remove_swap(audio->streams, i);
+                break;
+            }
+        }
+        SDL_UnlockMutex(audio->stream_lock);
+        audio_stream_delete(sound->stream);
+    }
+    free(sound->buffer);
+    audio_sound_free(sound);
 }
 
 void audio_delete(audio_t *self) {
     SDL_PauseAudioDevice(self->device, 1);
     SDL_CloseAudioDevice(self->device);
-    array_delete(self->handles);
-    free(self);
+    if (self->loader) {
+        SDL_AtomicSet(&self->loader_quit, 1);
+        SDL_WaitThread(self->loader, NULL);
+    }
+    while (self->loads->size) {
+        audio_load_poll(self);
+        SDL_Delay(1);
+    }
+    audio_free(self);
+}
+
+void audio_bench_mix() {
+    audio_t *self = audio_alloc(AUDIO_LATENCY_LOW);
+    self->obtained = self->desired;
+    self->obtained.samples = AUDIO_SAMPLES_LOW;
+    self->period = (int) ((int64_t) self->obtained.samples * 1000000 / self->obtained.freq);
+    uint32_t samples = (uint32_t) self->obtained.channels * self->obtained.samples;
+    uint32_t total = AUDIO_BENCH_CALLBACKS * samples;
+    sound_t *sound = audio_sound_new(self);
+    sound->buffer_size = total * sizeof(float);
+    sound->buffer = malloc_ext(sound->buffer_size);
+    float *src = (float*) sound->buffer;
+    for (uint32_t i = 0; i < total; i++) {
+        src[i] = 0.01f * sinf(0.05f * i);
+    }
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        audio_sound_play_ext(self, sound, 0.5f, 2.0f * i / (AUDIO_VOICES - 1) - 1.0f);
+    }
+    float *dst = malloc_ext(samples * sizeof(float));
+    int active = 0;
+    for (int i = 0; i < AUDIO_BENCH_CALLBACKS; i++) {
+        audio_callback(self, (uint8_t*) dst, (int32_t) (samples * sizeof(float)));
+        if (!i) {
+            for (int j = 0; j < AUDIO_VOICES; j++) {
+                active += self->voices[j].sound != NULL;
+            }
+        }
+    }
+    audio_stats_t stats = audio_stats(self);
+    printf("{\n");
+    printf("  \"voices\": %d,\n", active);
+    printf("  \"samples\": %d,\n", self->obtained.samples);
+    printf("  \"callbacks\": %d,\n", AUDIO_BENCH_CALLBACKS);
+    printf("  \"callback_us\": {\"mean\": %.2f, \"peak\": %.2f},\n", stats.callback_mean * 1000.0f, stats.callback_peak * 1000.0f);
+    printf("  \"budget_us\": %d\n", self->period);
+    printf("}\n");
+    free(dst);
+    free(sound->buffer);
+    audio_sound_free(sound);
+    audio_free(self);
+}
+
+void audio_bench_latency() {
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        printf("{\"error\": \"%s\"}\n", SDL_GetError());
+        return;
+    }
+    audio_t *self = audio_new_ext(AUDIO_LATENCY_LOW);
+    if (!self) {
+        printf("{\"error\": \"%s\"}\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return;
+    }
+    int initial = self->obtained.samples;
+    Uint32 start = SDL_GetTicks();
+    while (self->latency == AUDIO_LATENCY_LOW && self->obtained.samples < AUDIO_SAMPLES_MAX && SDL_GetTicks() - start < AUDIO_BENCH_TIMEOUT) {
+        Uint32 period = (Uint32) MAX(1, self->period / 1000);
+        SDL_LockAudioDevice(self->device);
+        SDL_Delay(3 * period);
+        SDL_UnlockAudioDevice(self->device);
+        SDL_Delay(period);
+        audio_update(self);
+    }
+    audio_stats_t stats = audio_stats(self);
+    printf("{\n");
+    printf("  \"driver\": \"%s\",\n", SDL_GetCurrentAudioDriver());
+    printf("  \"initial_samples\": %d,\n", initial);
+    printf("  \"samples\": %d,\n", stats.samples);
+    printf("  \"latency_ms\": %.2f,\n", stats.latency);
+    printf("  \"underruns\": %d,\n", stats.underruns);
+    printf("  \"seconds\": %.2f\n", (SDL_GetTicks() - start) / 1000.0f);
+    printf("}\n");
+    audio_delete(self);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
 }
@@ -0,0 +1,113 @@
+#include "../include/core.h"
+#include <SDL2/SDL.h>
+
+#define BENCH_ARRAY_SIZE 1000000
+#define BENCH_POOL_SIZE 1000000
+
+static volatile long long bench_sink;
+
+static float bench_ms(Uint64 ticks) {
+    return (float) ((double) ticks * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static bool bench_array_keep(void *item, void *userdata) {
+    return *(int*) item % *(int*) userdata == 0;
+}
+
+static array_t *bench_array_fill(int size) {
+    array_t *array = array_new(sizeof(int));
+    for (int i = 0; i < size; i++) {
+        array_add_last(array, &i);
+    }
+    return array;
+}
+
+void bench_array() {
+    int modulus = 2;
+    printf("{\n");
+    for (int size = BENCH_ARRAY_SIZE / 4; size <= BENCH_ARRAY_SIZE; size *= 2) {
+        array_t *array = bench_array_fill(size);
+        Uint64 start = SDL_GetPerformanceCounter();
+        size_t removed = array_filter(array, bench_array_keep, &modulus);
+        float filter = bench_ms(SDL_GetPerformanceCounter() - start);
+        array_delete(array);
+        array = bench_array_fill(size);
+        start = SDL_GetPerformanceCounter();
+        for (int i = (int) array->size - 1; i >= 0; i--) {
+            if (!bench_array_keep(array_get(array, i), &modulus)) {
+                array_remove_swap(array, i);
+            }
+        }
+        float swap = bench_ms(SDL_GetPerformanceCounter() - start);
+        array_delete(array);
+        printf("  \"%d\": {\"removed\": %llu, \"filter_ms\": %.3f, \"filter_ns\": %.3f, \"swap_ms\": %.3f, \"swap_ns\": %.3f}%s\n",
+               size, (unsigned long long) removed, filter, filter * 1000000.0f / size, swap, swap * 1000000.0f / size,
+               size * 2 <= BENCH_ARRAY_SIZE ? "," : "");
+    }
+    printf("}\n");
+}
+
+typedef struct bench_node_t {
+    struct bench_node_t *next;
+    int value;
+    char payload[20];
+} bench_node_t;
+
+static void bench_pool_link(bench_node_t **nodes, int count) {
+    for (int i = 0; i < count; i++) {
+        nodes[i]->value = i;
+        nodes[i]->next = i + 1 < count ? nodes[i + 1] : NULL;
+    }
+}
+
+static long long bench_pool_walk(bench_node_t *node) {
+    long long sum = 0;
+    for (; node; node = node->next) {
+        sum += node->value;
+    }
+    return sum;
+}
+
+static void bench_pool_report(const char *name, float alloc, float iterate, float release, bool last) {
+    printf("  \"%s\": {\"alloc_ms\": %.3f, \"iterate_ms\": %.3f, \"free_ms\": %.3f}%s\n", name, alloc, iterate, release, last ? "" : ",");
+}
+
+void bench_pool() {
+    bench_node_t **nodes = malloc_ext(BENCH_POOL_SIZE * sizeof(*nodes));
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_POOL_SIZE; i++) {
+        nodes[i] = malloc_ext(sizeof(bench_node_t));
+    }
+    float alloc = bench_ms(SDL_GetPerformanceCounter() - start);
+    bench_pool_link(nodes, BENCH_POOL_SIZE);
+    start = SDL_GetPerformanceCounter();
+    bench_sink += bench_pool_walk(nodes[0]);
+    float iterate = bench_ms(SDL_GetPerformanceCounter() - start);
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_POOL_SIZE; i++) {
+        free(nodes[i]);
+    }
+    float release = bench_ms(SDL_GetPerformanceCounter() - start);
+    printf("{\n");
+    printf("  \"count\": %d,\n", BENCH_POOL_SIZE);
+    bench_pool_report("malloc", alloc, iterate, release, false);
+    start = SDL_GetPerformanceCounter();
+    pool_t *pool = pool_new(sizeof(bench_node_t));
+    for (int i = 0; i < BENCH_POOL_SIZE; i++) {
+        nodes[i] = pool_alloc(pool);
+    }
+    alloc = bench_ms(SDL_GetPerformanceCounter() - start);
+    bench_pool_link(nodes, BENCH_POOL_SIZE);
+    start = SDL_GetPerformanceCounter();
+    bench_sink += bench_pool_walk(nodes[0]);
+    iterate = bench_ms(SDL_GetPerformanceCounter() - start);
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_POOL_SIZE; i++) {
+        pool_free(pool, nodes[i]);
+    }
+    pool_delete(pool);
+    release = bench_ms(SDL_GetPerformanceCounter() - start);
+    bench_pool_report("pool", alloc, iterate, release, true);
+    printf("}\n");
+    free(nodes);
+}
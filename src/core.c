@@ -1,4 +1,5 @@
 #include "../include/core.h"
+#include <stdarg.h>
 #include <stddef.h>
 #include <time.h>
 
@@ -34,18 +35,147 @@ void *realloc_ext(void *memory, size_t size) {
     return ptr;
 }
 
-size_t file_read(const char *filename, char *buffer, size_t size) {
-    FILE *file = fopen(filename, "r");
+char *file_read_all(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
     if (!file) {
 #ifdef DEBUG
-        printf("file_read: missing file %s\n", filename);
+        printf("file_read_all: missing file %s\n", filename);
 #endif
-        return 0;
+        return NULL;
+    }
+    size_t count = 0;
+    size_t capacity = 4096;
+    char *buffer = malloc_ext(capacity);
+    size_t read;
+    while ((read = fread(buffer + count, sizeof(char), capacity - count - 1, file)) > 0) {
+        count += read;
+        if (count + 1 == capacity) {
+            capacity *= 2;
+            buffer = realloc_ext(buffer, capacity);
+        }
     }
-    size_t count = fread(buffer, sizeof(char), size, file);
     fclose(file);
-    buffer[MIN(count, size - 1)] = '\0';
-    return count;
+    buffer[count] = '\0';
+    if (size) {
+        *size = count;
+    }
+    return buffer;
+}
+
+#define POOL_PAGE_SIZE 16384
+#define POOL_ALIGN 16
+
+pool_t *pool_new(size_t padding) {
+    pool_t *self = malloc_ext(sizeof(*self));
+    self->padding = (MAX(padding, sizeof(void*)) + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+    self->count = MAX(1, (POOL_PAGE_SIZE - POOL_ALIGN) / self->padding);
+    self->size = 0;
+    self->free = NULL;
+    self->pages = NULL;
+    return self;
+}
+
+void *pool_alloc(pool_t *self) {
+    if (!self->free) {
+        char *page = malloc_ext(POOL_ALIGN + self->count * self->padding);
+        *(void**) page = self->pages;
+        self->pages = page;
+        for (size_t i = self->count; i > 0; i--) {
+            void *item = page + POOL_ALIGN + (i - 1) * self->padding;
+            *(void**) item = self->free;
+            self->free = item;
+        }
+    }
+    void *item = self->free;
+    self->free = *(void**) item;
+    self->size++;
+    return item;
+}
+
+void pool_free(pool_t *self, void *item) {
+    *(void**) item = self->free;
+    self->free = item;
+    self->size--;
+}
+
+void pool_delete(pool_t *self) {
+    void *page = self->pages;
+    while (page) {
+        void *next = *(void**) page;
+        free(page);
+        page = next;
+    }
+    free(self);
+}
+
+#define ARENA_ALIGN 16
+
+static void arena_block_new(arena_t *self, size_t capacity) {
+    char *block = malloc_ext(ARENA_ALIGN + capacity);
+    *(void**) block = self->blocks;
+    self->blocks = block;
+    self->block = block + ARENA_ALIGN;
+    self->capacity = capacity;
+    self->offset = 0;
+}
+
+static void arena_blocks_free(arena_t *self) {
+    void *block = self->blocks;
+    while (block) {
+        void *next = *(void**) block;
+        free(block);
+        block = next;
+    }
+    self->blocks = NULL;
+}
+
+arena_t *arena_new(size_t capacity) {
+    arena_t *self = malloc_ext(sizeof(*self));
+    self->used = 0;
+    self->peak = 0;
+    self->blocks = NULL;
+    arena_block_new(self, MAX(capacity, ARENA_ALIGN));
+    return self;
+}
+
+void *arena_alloc(arena_t *self, size_t size) {
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (self->offset + size > self->capacity) {
+        arena_block_new(self, MAX(2 * self->capacity, size));
+    }
+    void *ptr = self->block + self->offset;
+    self->offset += size;
+    self->used += size;
+    self->peak = MAX(self->peak, self->used);
+    return ptr;
+}
+
+char *arena_printf(arena_t *self, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int size = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    char *str = arena_alloc(self, (size_t) MAX(size, 0) + 1);
+    vsnprintf(str, (size_t) MAX(size, 0) + 1, format, args);
+    va_end(args);
+    return str;
+}
+
+void arena_reset(arena_t *self) {
+    if (*(void**) self->blocks) {
+        size_t capacity = MAX(self->capacity, self->used);
+        arena_blocks_free(self);
+        arena_block_new(self, capacity);
+    }
+    self->offset = 0;
+    self->used = 0;
+}
+
+void arena_delete(arena_t *self) {
+    arena_blocks_free(self);
+    free(self);
 }
 
 static bool list_iterator_has_next(iterator_t *iterator) {
@@ -59,8 +189,9 @@ static void *list_iterator_next(iterator_t *iterator) {
     return node->data;
 }
 
-static list_node_t *list_node_new(size_t padding, void *item, list_node_t *next, list_node_t *prev) {
-    list_node_t *node = malloc_ext(sizeof(*node) + padding);
+static list_node_t *list_node_new(list_t *self, void *item, list_node_t *next, list_node_t *prev) {
+    size_t padding = self->padding;
+    list_node_t *node = pool_alloc(self->pool);
     node->next = next;
     node->prev = prev;
     if (item) {
@@ -74,6 +205,7 @@ static list_node_t *list_node_new(size_t padding, void *item, list_node_t *next,
 list_t *list_new(size_t padding) {
     list_t *self = malloc_ext(sizeof(*self));
     self->padding = padding;
+    self->pool = pool_new(sizeof(list_node_t) + padding);
     self->size = 0;
     self->head = NULL;
     self->tail = NULL;
@@ -81,11 +213,11 @@ list_t *list_new(size_t padding) {
 }
 
 void *list_add_first(list_t *self, void *item) {
-    list_node_t *node = list_node_new(self->padding, item, self->head, NULL);
-    self->head = node;
+    list_node_t *node = list_node_new(self, item, self->head, NULL);
     if (self->head) {
         self->head->prev = node;
     }
+    self->head = node;
     if (!self->tail) {
         self->tail = node;
     }
@@ -94,7 +226,7 @@ void *list_add_first(list_t *self, void *item) {
 }
 
 void *list_add_last(list_t *self, void *item) {
-    list_node_t *node = list_node_new(self->padding, item, NULL, self->tail);
+    list_node_t *node = list_node_new(self, item, NULL, self->tail);
     if (!self->head) {
         self->head = node;
     }
@@ -117,12 +249,7 @@ iterator_t list_iterator(list_t *self) {
 }
 
 void list_delete(list_t *self) {
-    list_node_t *node = self->head;
-    while (node) {
-        list_node_t *tmp = node;
-        node = node->next;
-        free(tmp);
-    }
+    pool_delete(self->pool);
     free(self);
 }
 
@@ -143,7 +270,9 @@ static void *array_iterator_next(iterator_t *iterator) {
 static void array_iterator_remove(iterator_t *iterator) {
     array_t *self = iterator->ptr_base;
     ptrdiff_t index = iterator->ptr_prev - self->data;
-    array_remove(self, (int) index);
+    if (array_remove(self, (int) index)) {
+        iterator->ptr_next = iterator->ptr_prev;
+    }
 }
 
 array_t *array_new(size_t padding) {
@@ -203,7 +332,7 @@ bool array_remove(array_t *self, int index) {
     if (index < 0 || index >= self->size) {
         return false;
     }
-    size_t count = self->size - index;
+    size_t count = self->size - index - 1;
     void *prev = self->data + index * self->padding;
     void *next = self->data + (index + 1) * self->padding;
     memmove(prev, next, count * self->padding);
@@ -211,6 +340,17 @@ bool array_remove(array_t *self, int index) {
     return true;
 }
 
+bool array_remove_swap(array_t *self, int index) {
+    if (index < 0 || index >= self->size) {
+        return false;
+    }
+    self->size--;
+    if (index != self->size) {
+        memcpy(self->data + index * self->padding, self->data + self->size * self->padding, self->padding);
+    }
+    return true;
+}
+
 bool array_remove_first(array_t *self) {
     return array_remove(self, 0);
 }
@@ -219,6 +359,23 @@ bool array_remove_last(array_t *self) {
     return array_remove(self, (int) (self->size - 1));
 }
 
+size_t array_filter(array_t *self, bool (*predicate)(void*, void*), void *userdata) {
+    size_t size = 0;
+    for (size_t i = 0; i < self->size; i++) {
+        void *item = self->data + i * self->padding;
+        if (!predicate(item, userdata)) {
+            continue;
+        }
+        if (i != size) {
+            memcpy(self->data + size * self->padding, item, self->padding);
+        }
+        size++;
+    }
+    size_t removed = self->size - size;
+    self->size = size;
+    return removed;
+}
+
 iterator_t array_iterator(array_t *self) {
     return (iterator_t) {
             .has_next = array_iterator_has_next,
@@ -1,12 +1,30 @@
 #include "../include/ctx.h"
 #include "../include/audio.h"
 #include "../include/video.h"
+#include "../include/profiler.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <stddef.h>
 #ifdef __EMSCRIPTEN__
+#include <GLES2/gl2.h>
 #include <emscripten/emscripten.h>
+#else
+#include <epoxy/gl.h>
 #endif
 
+#define CTX_ARENA_SIZE 65536
+#define CTX_TICK_CATCHUP 5
+#define CTX_BENCH_FRAMES 600
+
+typedef struct ctx_sample_t {
+    float frame;
+    float tick;
+    float draw;
+    float draws;
+    float bytes;
+    float memory;
+} ctx_sample_t;
+
 static SDL_Window *window;
 static SDL_GLContext gl;
 static audio_t *audio;
@@ -14,11 +32,94 @@ static video_t *video;
 static bool running;
 static vec2_t mouse_pos;
 static void (*mouse_hook)(vec2_t);
+static arena_t *arena;
+static arena_t *arena_carry[2];
+static int arena_index;
+static bool fast_forward;
+static Uint64 tick_count;
+static Uint64 tick_limit;
+static Uint64 tick_last;
+static Uint64 tick_accumulator;
+static double advance_seconds;
+static bool headless;
+static int frame_count;
+static int frame_limit;
+static array_t *samples;
+static profiler_t *profiler;
+static font_t *profiler_font;
+static bool profiler_visible;
+static Uint64 launch;
+static float startup;
+static void (*bench)();
+
+static void ctx_quit() {
+#ifdef __EMSCRIPTEN__
+    emscripten_cancel_main_loop();
+#else
+    running = false;
+#endif
+}
+
+static bool ctx_tick(sketch_t *sketch) {
+    sketch->tick();
+    tick_count++;
+    if (tick_limit && tick_count >= tick_limit) {
+        ctx_quit();
+        return false;
+    }
+    return true;
+}
+
+static float ctx_ms(Uint64 ticks) {
+    return (float) ((double) ticks * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static int ctx_sample_compare(const void *a, const void *b) {
+    float value_a = *(const float*) a;
+    float value_b = *(const float*) b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+static void ctx_report_metric(const char *name, size_t offset, bool last) {
+    float *values = malloc_ext(samples->size * sizeof(float));
+    double sum = 0;
+    for (int i = 0; i < samples->size; i++) {
+        values[i] = *(float*) ((uint8_t*) array_get(samples, i) + offset);
+        sum += values[i];
+    }
+    qsort(values, samples->size, sizeof(float), ctx_sample_compare);
+    size_t p50 = (samples->size * 50 + 99) / 100 - 1;
+    size_t p99 = (samples->size * 99 + 99) / 100 - 1;
+    printf("  \"%s\": {\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n", name, values[0], sum / samples->size, values[p50], values[p99], values[samples->size - 1], last ? "" : ",");
+    free(values);
+}
+
+static void ctx_report() {
+    if (!samples->size) {
+        return;
+    }
+    printf("{\n");
+    printf("  \"renderer\": \"%s\",\n", (const char*) glGetString(GL_RENDERER));
+    printf("  \"frames\": %llu,\n", (unsigned long long) samples->size);
+    printf("  \"startup_ms\": %.2f,\n", startup);
+    ctx_report_metric("frame_ms", offsetof(ctx_sample_t, frame), false);
+    ctx_report_metric("tick_ms", offsetof(ctx_sample_t, tick), false);
+    ctx_report_metric("draw_ms", offsetof(ctx_sample_t, draw), false);
+    ctx_report_metric("draw_calls", offsetof(ctx_sample_t, draws), false);
+    ctx_report_metric("upload_bytes", offsetof(ctx_sample_t, bytes), false);
+    ctx_report_metric("queue_bytes", offsetof(ctx_sample_t, memory), true);
+    printf("}\n");
+}
 
 static void ctx_loop(void *arg) {
     SDL_Event event;
+    Uint64 frame_start = SDL_GetPerformanceCounter();
     sketch_t *sketch = arg;
     vec2_t viewport = ctx_viewport();
+    arena_index ^= 1;
+    arena_reset(arena_carry[arena_index]);
+    arena_reset(arena);
+    profiler_begin(profiler, PROFILER_EVENTS);
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
             case SDL_FINGERDOWN:
@@ -30,6 +131,10 @@ static void ctx_loop(void *arg) {
                 }
                 break;
             case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_F3 && !event.key.repeat) {
+                    profiler_visible = !profiler_visible;
+                }
+                break;
             case SDL_KEYUP:
                 break;
             case SDL_MOUSEBUTTONDOWN:
@@ -45,32 +150,140 @@ static void ctx_loop(void *arg) {
                 mouse_pos.y = event.motion.y;
                 break;
             case SDL_QUIT:
-#ifdef __EMSCRIPTEN__
-                emscripten_cancel_main_loop();
-#else
-                running = false;
-#endif
+                ctx_quit();
                 break;
             default:
                 break;
         }
     }
-    sketch->tick();
+    if (audio) {
+        audio_update(audio);
+    }
+    profiler_end(profiler, PROFILER_EVENTS);
+    profiler_begin(profiler, PROFILER_TICK);
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 period = SDL_GetPerformanceFrequency() / CTX_TICK_RATE;
+    if (samples) {
+        ctx_tick(sketch);
+        tick_accumulator = 0;
+    } else if (fast_forward) {
+        while (SDL_GetPerformanceCounter() - now < period) {
+            if (!ctx_tick(sketch)) {
+                break;
+            }
+        }
+        tick_accumulator = 0;
+    } else {
+        tick_accumulator += now - tick_last;
+        if (tick_accumulator > CTX_TICK_CATCHUP * period) {
+            Uint64 skipped = tick_accumulator / period - CTX_TICK_CATCHUP;
+            if (sketch->advance) {
+                sketch->advance((double) skipped / CTX_TICK_RATE);
+                tick_accumulator -= skipped * period;
+            } else {
+                tick_accumulator = CTX_TICK_CATCHUP * period;
+            }
+        }
+        while (tick_accumulator >= period) {
+            tick_accumulator -= period;
+            if (!ctx_tick(sketch)) {
+                break;
+            }
+        }
+    }
+    tick_last = now;
+    profiler_end(profiler, PROFILER_TICK);
+    profiler_begin(profiler, PROFILER_DRAW);
+    profiler_gpu_begin(profiler);
+    Uint64 draw_start = SDL_GetPerformanceCounter();
     video_clear(video);
-    sketch->draw(video);
+    if (samples && samples->size) {
+        ctx_sample_t *sample = array_get_last(samples);
+        video_stats_t stats = video_stats(video);
+        sample->draws = (float) stats.draws;
+        sample->bytes = (float) stats.bytes;
+        sample->memory = (float) stats.memory;
+    }
+    sketch->draw(video, (float) tick_accumulator / (float) period);
+    if (profiler_visible && profiler_font) {
+        profiler_draw(profiler, video, profiler_font, 10, 10);
+    }
+    video_flush(video);
+    profiler_gpu_end(profiler);
+    profiler_end(profiler, PROFILER_DRAW);
+    profiler_begin(profiler, PROFILER_SWAP);
     SDL_GL_SwapWindow(window);
+    if (!startup) {
+        startup = ctx_ms(SDL_GetPerformanceCounter() - launch);
+    }
+    profiler_end(profiler, PROFILER_SWAP);
+    profiler_frame(profiler);
+    if (samples) {
+        glFinish();
+        Uint64 frame_end = SDL_GetPerformanceCounter();
+        if (frame_count++ == frame_limit) {
+            ctx_quit();
+            return;
+        }
+        ctx_sample_t sample = {
+                .frame = ctx_ms(frame_end - frame_start),
+                .tick = ctx_ms(draw_start - now),
+                .draw = ctx_ms(frame_end - draw_start),
+                .draws = 0,
+                .bytes = 0,
+                .memory = 0
+        };
+        array_add_last(samples, &sample);
+    }
 }
 
 int ctx_main(int argc, char **argv, sketch_t *sketch) {
+    launch = SDL_GetPerformanceCounter();
     core_init();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fast-forward")) {
+            fast_forward = true;
+        } else if (!strcmp(argv[i], "--ticks") && i + 1 < argc) {
+            tick_limit = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--advance") && i + 1 < argc) {
+            advance_seconds = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--headless")) {
+            headless = true;
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_limit = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench-array")) {
+            bench = bench_array;
+        } else if (!strcmp(argv[i], "--bench-pool")) {
+            bench = bench_pool;
+        } else if (!strcmp(argv[i], "--bench-mix")) {
+            bench = audio_bench_mix;
+        } else if (!strcmp(argv[i], "--bench-latency")) {
+            bench = audio_bench_latency;
+        }
+    }
+    if (bench) {
+        bench();
+        return EXIT_SUCCESS;
+    }
+    if (headless) {
+        frame_limit = frame_limit > 0 ? frame_limit : CTX_BENCH_FRAMES;
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO)) {
-        return EXIT_FAILURE;
+        if (!headless) {
+            return EXIT_FAILURE;
+        }
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "");
+        if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO)) {
+            return EXIT_FAILURE;
+        }
     }
     if (!IMG_Init(IMG_INIT_PNG)) {
         SDL_Quit();
         return EXIT_FAILURE;
     }
-    window = SDL_CreateWindow("Daniel Clicker", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 768, SDL_WINDOW_OPENGL);
+    window = SDL_CreateWindow("Daniel Clicker", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1280, 768, SDL_WINDOW_OPENGL | (headless ? SDL_WINDOW_HIDDEN : 0));
     if (!window) {
         IMG_Quit();
         SDL_Quit();
@@ -88,9 +301,22 @@ int ctx_main(int argc, char **argv, sketch_t *sketch) {
         SDL_Quit();
         return EXIT_FAILURE;
     }
-    SDL_GL_SetSwapInterval(1);
+    SDL_GL_SetSwapInterval(fast_forward || frame_limit > 0 ? 0 : 1);
+    job_init();
+    arena = arena_new(CTX_ARENA_SIZE);
+    arena_carry[0] = arena_new(CTX_ARENA_SIZE);
+    arena_carry[1] = arena_new(CTX_ARENA_SIZE);
     video = video_new();
+    profiler = profiler_new();
     sketch->init();
+    if (advance_seconds > 0 && sketch->advance) {
+        sketch->advance(advance_seconds);
+    }
+    if (frame_limit > 0) {
+        samples = array_new(sizeof(ctx_sample_t));
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    tick_last = start;
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop_arg(ctx_loop, sketch, 0, 1);
 #else
@@ -99,13 +325,26 @@ int ctx_main(int argc, char **argv, sketch_t *sketch) {
         ctx_loop(sketch);
     }
 #endif
+    if (fast_forward) {
+        double elapsed = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+        printf("fast-forward: %llu ticks in %.3f s (%.0f ticks/s)\n", (unsigned long long) tick_count, elapsed, tick_count / elapsed);
+    }
+    if (samples) {
+        ctx_report();
+        array_delete(samples);
+    }
     sketch->shutdown();
     if (audio) {
         audio_delete(audio);
     }
+    profiler_delete(profiler);
     video_delete(video);
     SDL_GL_DeleteContext(gl);
     SDL_DestroyWindow(window);
+    job_shutdown();
+    arena_delete(arena);
+    arena_delete(arena_carry[0]);
+    arena_delete(arena_carry[1]);
     IMG_Quit();
     SDL_Quit();
     return EXIT_SUCCESS;
@@ -119,11 +358,27 @@ vec2_t ctx_viewport() {
 
 audio_t *ctx_audio() {
     if (!audio) {
-        audio = audio_new();
+        audio = audio_new_ext(AUDIO_LATENCY_LOW);
     }
     return audio;
 }
 
+video_t *ctx_video() {
+    return video;
+}
+
+arena_t *ctx_arena() {
+    return arena;
+}
+
+arena_t *ctx_arena_next() {
+    return arena_carry[arena_index];
+}
+
+void ctx_profiler_font(font_t *font) {
+    profiler_font = font;
+}
+
 void ctx_hook_mouse(void (*hook)(vec2_t)) {
     mouse_hook = hook;
 }
\ No newline at end of file
@@ -1,13 +1,9 @@
 #include "video_private.h"
 
-font_t *font_load(const char *filename_desc, const char *filename_sprite) {
+static font_t *font_load_desc(const char *filename_desc, sprite_t *sprite) {
     FILE *file = fopen(filename_desc, "r");
     if (!file) {
-        return NULL;
-    }
-    sprite_t *sprite = sprite_load(filename_sprite);
-    if (!sprite) {
-        fclose(file);
+        sprite_delete(sprite);
         return NULL;
     }
     font_t *self = malloc_ext(sizeof(*self));
@@ -38,6 +34,26 @@ font_t *font_load(const char *filename_desc, const char *filename_sprite) {
     return self;
 }
 
+font_t *font_load(const char *filename_desc, const char *filename_sprite) {
+    sprite_t *sprite = sprite_load(filename_sprite);
+    if (!sprite) {
+        return NULL;
+    }
+    return font_load_desc(filename_desc, sprite);
+}
+
+font_t *font_load_atlas(atlas_t *atlas, const char *filename_desc, const char *filename_sprite) {
+    sprite_t *sprite = atlas_add(atlas, filename_sprite);
+    if (!sprite) {
+        return NULL;
+    }
+    return font_load_desc(filename_desc, sprite);
+}
+
+font_t *font_load_atlas_async(atlas_t *atlas, const char *filename_desc, const char *filename_sprite) {
+    return font_load_desc(filename_desc, atlas_add_async(atlas, filename_sprite));
+}
+
 void video_text(video_t *self, font_t *font, const char *str, float x, float y) {
     video_sprite_begin(self, font->sprite);
     while (*str) {
@@ -56,3 +72,147 @@ void font_delete(font_t *self) {
     sprite_delete(self->sprite);
     free(self);
 }
+
+text_t *text_new(font_t *font, float x, float y) {
+    text_t *self = malloc_ext(sizeof(*self));
+    self->font = font;
+    self->x = x;
+    self->y = y;
+    self->height = 0;
+    for (int i = 0; i < 128; i++) {
+        if (font->glyphs[i].enabled) {
+            self->height = MAX(self->height, font->glyphs[i].offset.y + font->glyphs[i].bounds.w);
+        }
+    }
+    self->length = 0;
+    self->capacity = 0;
+    self->str = NULL;
+    self->pens = NULL;
+    self->quads = NULL;
+    self->vertices = NULL;
+    self->color = video_color_pack(vec4_new(1, 1, 1, 1));
+    self->vbo_capacity = 0;
+    self->count = 0;
+    glGenBuffers(1, &self->vbo);
+    text_set(self, "");
+    return self;
+}
+
+static void text_reserve(text_t *self, size_t length) {
+    if (length < self->capacity) {
+        return;
+    }
+    self->capacity = MAX(length + 1, 2 * self->capacity);
+    self->str = realloc_ext(self->str, self->capacity);
+    self->pens = realloc_ext(self->pens, self->capacity * sizeof(float));
+    self->quads = realloc_ext(self->quads, self->capacity * sizeof(size_t));
+    self->vertices = realloc_ext(self->vertices, self->capacity * 30 * sizeof(float));
+}
+
+static void text_color(text_t *self, size_t first) {
+    for (size_t i = 6 * first; i < 6 * self->count; i++) {
+        memcpy(self->vertices + i * 5 + 4, &self->color, sizeof(self->color));
+    }
+}
+
+void text_set(text_t *self, const char *str) {
+    size_t length = strlen(str);
+    size_t prefix = 0;
+    while (prefix < length && prefix < self->length && self->str[prefix] == str[prefix]) {
+        prefix++;
+    }
+    if (self->str && prefix == length && prefix == self->length) {
+        return;
+    }
+    text_reserve(self, length);
+    memcpy(self->str + prefix, str + prefix, length - prefix + 1);
+    self->length = length;
+    sprite_t *sprite = self->font->sprite;
+    float sx = 1.0f / sprite->tex_w;
+    float sy = 1.0f / sprite->tex_h;
+    float x = prefix ? self->pens[prefix] : self->x;
+    size_t quads = prefix ? self->quads[prefix] : 0;
+    size_t first = quads;
+    for (size_t i = prefix; i < length; i++) {
+        unsigned char c = (unsigned char) str[i];
+        self->pens[i] = x;
+        self->quads[i] = quads;
+        if (c >= 128 || !self->font->glyphs[c].enabled) {
+            continue;
+        }
+        glyph_t glyph = self->font->glyphs[c];
+        float x_min = x + glyph.offset.x;
+        float x_max = x_min + glyph.bounds.z;
+        float y_min = self->y + glyph.offset.y;
+        float y_max = y_min + glyph.bounds.w;
+        float s_min = sx * (sprite->x + glyph.bounds.x);
+        float s_max = sx * (sprite->x + glyph.bounds.x + glyph.bounds.z);
+        float t_min = sy * (sprite->y + glyph.bounds.y);
+        float t_max = sy * (sprite->y + glyph.bounds.y + glyph.bounds.w);
+        float quad[30] = {
+                x_min, y_max, s_min, t_max, 0,
+                x_min, y_min, s_min, t_min, 0,
+                x_max, y_min, s_max, t_min, 0,
+                x_min, y_max, s_min, t_max, 0,
+                x_max, y_min, s_max, t_min, 0,
+                x_max, y_max, s_max, t_max, 0
+        };
+        memcpy(self->vertices + quads * 30, quad, sizeof(quad));
+        quads++;
+        x += glyph.x_adv;
+    }
+    self->pens[length] = x;
+    self->quads[length] = quads;
+    self->count = quads;
+    text_color(self, first);
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo);
+    if (quads > self->vbo_capacity) {
+        self->vbo_capacity = self->capacity;
+        glBufferData(GL_ARRAY_BUFFER, self->vbo_capacity * 30 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        first = 0;
+    }
+    if (quads > first) {
+        glBufferSubData(GL_ARRAY_BUFFER, first * 30 * sizeof(float), (quads - first) * 30 * sizeof(float), self->vertices + first * 30);
+    }
+}
+
+void video_text_run(video_t *self, text_t *text) {
+    if (!text->count) {
+        return;
+    }
+    video_cfg_t *cfg = array_get_last(self->configs);
+    if (text->color != cfg->packed) {
+        text->color = cfg->packed;
+        text_color(text, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, text->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, text->count * 30 * sizeof(float), text->vertices);
+    }
+    video_env_set(self, &self->env_textured);
+    self->batch_texture = text->font->sprite->texture;
+    if (!video_transform_identity(cfg->transform)) {
+        if (!self->deferred) {
+            glBindTexture(GL_TEXTURE_2D, self->batch_texture);
+            self->stats_frame.binds++;
+        }
+        size_t chunk = VIDEO_BUFFER_SIZE / 30;
+        for (size_t first = 0; first < text->count; first += chunk) {
+            size_t quads = MIN(chunk, text->count - first);
+            memcpy(self->buffer, text->vertices + first * 30, quads * 30 * sizeof(float));
+            self->buffer_size = quads * 30;
+            video_data_draw(self, GL_TRIANGLES, 6 * quads);
+        }
+        video_data_clear(self);
+        return;
+    }
+    vec4_t bounds = vec4_new(text->x - 1, text->y - 1, text->pens[text->length] + 1, text->y + text->height + 1);
+    video_data_retained(self, GL_TRIANGLES, text->vbo, 0, 6 * text->count, bounds);
+}
+
+void text_delete(text_t *self) {
+    glDeleteBuffers(1, &self->vbo);
+    free(self->str);
+    free(self->pens);
+    free(self->quads);
+    free(self->vertices);
+    free(self);
+}
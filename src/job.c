@@ -0,0 +1,205 @@
+#include "../include/core.h"
+#include <SDL2/SDL.h>
+
+#define JOB_QUEUE_SIZE 4096
+#define JOB_WORKERS_MAX 64
+
+typedef struct job_t {
+    void (*fn)(void*, size_t, size_t);
+    void *userdata;
+    size_t begin;
+    size_t end;
+    SDL_atomic_t *pending;
+    bool background;
+} job_t;
+
+typedef struct job_queue_t {
+    SDL_SpinLock lock;
+    size_t top;
+    size_t bottom;
+    job_t jobs[JOB_QUEUE_SIZE];
+} job_queue_t;
+
+static job_queue_t *queues;
+static SDL_Thread *threads[JOB_WORKERS_MAX];
+static int workers;
+static SDL_TLSID worker_index;
+static SDL_atomic_t queued;
+static SDL_atomic_t running;
+static SDL_atomic_t detached;
+static SDL_atomic_t submitted;
+static SDL_mutex *idle_mutex;
+static SDL_cond *idle_cond;
+
+static bool job_queue_push(job_queue_t *queue, job_t *job) {
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom - queue->top >= JOB_QUEUE_SIZE) {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+    queue->jobs[queue->bottom % JOB_QUEUE_SIZE] = *job;
+    queue->bottom++;
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+static bool job_queue_pop(job_queue_t *queue, job_t *job) {
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom == queue->top) {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+    queue->bottom--;
+    *job = queue->jobs[queue->bottom % JOB_QUEUE_SIZE];
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+static bool job_queue_steal(job_queue_t *queue, job_t *job, bool background) {
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom == queue->top || (!background && queue->jobs[queue->top % JOB_QUEUE_SIZE].background)) {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+    *job = queue->jobs[queue->top % JOB_QUEUE_SIZE];
+    queue->top++;
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+static int job_index() {
+    return (int) (intptr_t) SDL_TLSGet(worker_index);
+}
+
+static bool job_take(int index, job_t *job) {
+    if (job_queue_pop(&queues[index], job)) {
+        return true;
+    }
+    for (int i = 1; i <= workers; i++) {
+        if (job_queue_steal(&queues[(index + i) % (workers + 1)], job, index != 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void job_run(job_t *job) {
+    SDL_AtomicAdd(&queued, -1);
+    job->fn(job->userdata, job->begin, job->end);
+    SDL_AtomicAdd(job->pending, -1);
+}
+
+static int job_worker(void *userdata) {
+    int index = (int) (intptr_t) userdata;
+    SDL_TLSSet(worker_index, userdata, NULL);
+    job_t job;
+    while (SDL_AtomicGet(&running)) {
+        if (job_take(index, &job)) {
+            job_run(&job);
+            continue;
+        }
+        SDL_LockMutex(idle_mutex);
+        if (!SDL_AtomicGet(&queued) && SDL_AtomicGet(&running)) {
+            SDL_CondWaitTimeout(idle_cond, idle_mutex, 10);
+        }
+        SDL_UnlockMutex(idle_mutex);
+    }
+    return 0;
+}
+
+void job_init() {
+#ifdef __EMSCRIPTEN__
+    workers = 0;
+#else
+    workers = MIN(MAX(SDL_GetCPUCount() - 1, 0), JOB_WORKERS_MAX);
+#endif
+    queues = malloc_ext((workers + 1) * sizeof(job_queue_t));
+    for (int i = 0; i <= workers; i++) {
+        queues[i].lock = 0;
+        queues[i].top = 0;
+        queues[i].bottom = 0;
+    }
+    worker_index = SDL_TLSCreate();
+    SDL_AtomicSet(&queued, 0);
+    SDL_AtomicSet(&running, 1);
+    SDL_AtomicSet(&detached, 0);
+    SDL_AtomicSet(&submitted, 0);
+    idle_mutex = SDL_CreateMutex();
+    idle_cond = SDL_CreateCond();
+    for (int i = 0; i < workers; i++) {
+        threads[i] = SDL_CreateThread(job_worker, "job_worker", (void*) (intptr_t) (i + 1));
+        if (!threads[i]) {
+            workers = i;
+            break;
+        }
+    }
+}
+
+int job_workers() {
+    return workers;
+}
+
+void job_parallel_for(size_t count, size_t grain, void (*fn)(void*, size_t, size_t), void *userdata) {
+    if (!workers || count <= grain) {
+        if (count) {
+            fn(userdata, 0, count);
+        }
+        return;
+    }
+    size_t chunk = MAX(grain, (count + 4 * (workers + 1) - 1) / (4 * (workers + 1)));
+    int index = job_index();
+    SDL_atomic_t pending;
+    SDL_AtomicSet(&pending, 0);
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        job_t job = {fn, userdata, begin, MIN(begin + chunk, count), &pending, false};
+        SDL_AtomicAdd(&pending, 1);
+        SDL_AtomicAdd(&queued, 1);
+        if (!job_queue_push(&queues[index], &job)) {
+            job_run(&job);
+        }
+    }
+    SDL_LockMutex(idle_mutex);
+    SDL_CondBroadcast(idle_cond);
+    SDL_UnlockMutex(idle_mutex);
+    job_t job;
+    while (SDL_AtomicGet(&pending)) {
+        if (job_take(index, &job)) {
+            job_run(&job);
+        }
+    }
+}
+
+void job_submit(void (*fn)(void*, size_t, size_t), void *userdata) {
+    if (!workers) {
+        fn(userdata, 0, 1);
+        return;
+    }
+    job_t job = {fn, userdata, 0, 1, &detached, true};
+    SDL_AtomicAdd(&detached, 1);
+    SDL_AtomicAdd(&queued, 1);
+    int index = 1 + (int) ((unsigned int) SDL_AtomicAdd(&submitted, 1) % (unsigned int) workers);
+    if (!job_queue_push(&queues[index], &job)) {
+        job_run(&job);
+        return;
+    }
+    SDL_LockMutex(idle_mutex);
+    SDL_CondBroadcast(idle_cond);
+    SDL_UnlockMutex(idle_mutex);
+}
+
+void job_shutdown() {
+    while (SDL_AtomicGet(&detached)) {
+        SDL_Delay(1);
+    }
+    SDL_AtomicSet(&running, 0);
+    SDL_LockMutex(idle_mutex);
+    SDL_CondBroadcast(idle_cond);
+    SDL_UnlockMutex(idle_mutex);
+    for (int i = 0; i < workers; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+    SDL_DestroyCond(idle_cond);
+    SDL_DestroyMutex(idle_mutex);
+    free(queues);
+    workers = 0;
+}
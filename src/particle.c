@@ -1,9 +1,35 @@
 #include "video_private.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 emitter_t *emitter_new(sprite_t *sprite) {
+    return emitter_new_ext(sprite, EMITTER_ARRAY);
+}
+
+emitter_t *emitter_new_ext(sprite_t *sprite, emitter_mode mode) {
     emitter_t *self = malloc_ext(sizeof(*self));
+    self->mode = mode;
     self->particles = array_new(sizeof(particle_t));
     self->sprite = sprite;
+    self->size = 0;
+    self->capacity = 0;
+    self->position = NULL;
+    self->velocity = NULL;
+    self->color = NULL;
+    self->lifetime = NULL;
+    self->vbo = 0;
+    self->head = 0;
+    self->time = 0;
+    self->expiry = 0;
+    if (mode == EMITTER_GPU) {
+        self->capacity = EMITTER_GPU_CAPACITY;
+        glGenBuffers(1, &self->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, self->vbo);
+        glBufferData(GL_ARRAY_BUFFER, self->capacity * EMITTER_GPU_STRIDE * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    }
     return self;
 }
 
@@ -12,54 +38,281 @@ particle_t *emitter_emit(emitter_t *self, float x, float y) {
     particle->position.x = x;
     particle->position.y = y;
     particle->lifetime = 300;
+    particle->spawn = self->time;
     return particle;
 }
 
+static void emitter_reserve(emitter_t *self, size_t size) {
+    if (size <= self->capacity) {
+        return;
+    }
+    self->capacity = MAX(size, 2 * self->capacity + 1);
+    self->position = realloc_ext(self->position, 2 * self->capacity * sizeof(float));
+    self->velocity = realloc_ext(self->velocity, 2 * self->capacity * sizeof(float));
+    self->color = realloc_ext(self->color, 4 * self->capacity * sizeof(float));
+    self->lifetime = realloc_ext(self->lifetime, self->capacity * sizeof(int32_t));
+}
+
+static void emitter_commit(emitter_t *self) {
+    if (self->mode != EMITTER_SOA || !self->particles->size) {
+        return;
+    }
+    emitter_reserve(self, self->size + self->particles->size);
+    iterator_t iterator = array_iterator(self->particles);
+    while (iterator_has_next(iterator)) {
+        particle_t *particle = iterator_next(iterator);
+        size_t i = self->size++;
+        memcpy(self->position + 2 * i, particle->position.ptr, 2 * sizeof(float));
+        memcpy(self->velocity + 2 * i, particle->velocity.ptr, 2 * sizeof(float));
+        memcpy(self->color + 4 * i, particle->color.ptr, 4 * sizeof(float));
+        self->lifetime[i] = particle->lifetime;
+    }
+    self->particles->size = 0;
+}
+
+static void emitter_compact(emitter_t *self) {
+    size_t size = 0;
+    for (size_t i = 0; i < self->size; i++) {
+        if (self->lifetime[i] <= 0) {
+            continue;
+        }
+        if (i != size) {
+            memcpy(self->position + 2 * size, self->position + 2 * i, 2 * sizeof(float));
+            memcpy(self->velocity + 2 * size, self->velocity + 2 * i, 2 * sizeof(float));
+            memcpy(self->color + 4 * size, self->color + 4 * i, 4 * sizeof(float));
+            self->lifetime[size] = self->lifetime[i];
+        }
+        size++;
+    }
+    self->size = size;
+}
+
+static void emitter_integrate(float *position, const float *velocity, int32_t *lifetime, size_t size) {
+    size_t i = 0;
+#if defined(__AVX__)
+    for (; i + 8 <= 2 * size; i += 8) {
+        _mm256_storeu_ps(position + i, _mm256_add_ps(_mm256_loadu_ps(position + i), _mm256_loadu_ps(velocity + i)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= 2 * size; i += 4) {
+        _mm_storeu_ps(position + i, _mm_add_ps(_mm_loadu_ps(position + i), _mm_loadu_ps(velocity + i)));
+    }
+#endif
+    for (; i < 2 * size; i++) {
+        position[i] += velocity[i];
+    }
+    i = 0;
+#if defined(__AVX2__)
+    __m256i one8 = _mm256_set1_epi32(1);
+    for (; i + 8 <= size; i += 8) {
+        __m256i *ptr = (__m256i*) (lifetime + i);
+        _mm256_storeu_si256(ptr, _mm256_sub_epi32(_mm256_loadu_si256(ptr), one8));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i one4 = _mm_set1_epi32(1);
+    for (; i + 4 <= size; i += 4) {
+        __m128i *ptr = (__m128i*) (lifetime + i);
+        _mm_storeu_si128(ptr, _mm_sub_epi32(_mm_loadu_si128(ptr), one4));
+    }
+#endif
+    for (; i < size; i++) {
+        lifetime[i]--;
+    }
+}
+
+static bool emitter_tick_particle(void *item, void *userdata) {
+    particle_t *particle = item;
+    if (particle->lifetime <= 0) {
+        return false;
+    }
+    particle->position = vec2_add(particle->position, particle->velocity);
+    particle->lifetime--;
+    return true;
+}
+
+static void emitter_integrate_range(void *userdata, size_t begin, size_t end) {
+    emitter_t *self = userdata;
+    emitter_integrate(self->position + 2 * begin, self->velocity + 2 * begin, self->lifetime + begin, end - begin);
+}
+
+static void emitter_tick_range(void *userdata, size_t begin, size_t end) {
+    emitter_t **emitters = userdata;
+    for (size_t i = begin; i < end; i++) {
+        emitter_tick(emitters[i]);
+    }
+}
+
 void emitter_tick(emitter_t *self) {
+    if (self->mode == EMITTER_GPU) {
+        self->time++;
+        return;
+    }
+    if (self->mode == EMITTER_SOA) {
+        emitter_commit(self);
+        emitter_compact(self);
+        job_parallel_for(self->size, EMITTER_GRAIN_SIZE, emitter_integrate_range, self);
+        return;
+    }
+    array_filter(self->particles, emitter_tick_particle, NULL);
+}
+
+void emitter_tick_all(emitter_t **emitters, size_t count) {
+    job_parallel_for(count, 1, emitter_tick_range, emitters);
+}
+
+static void emitter_flush(video_t *video) {
+    if (video->batch_size) {
+        size_t offset = video_data_send(video, 1, 6 * sizeof(float));
+        video_env_instances(video, video->env, offset, offset + 2 * sizeof(float), 6 * sizeof(float));
+        glDrawArraysInstancedANGLE(GL_TRIANGLE_FAN, video->batch_first, 4, (GLsizei) video->batch_size);
+        video->stats_frame.commands++;
+        video->stats_frame.draws++;
+    }
+    video_data_clear(video);
+    video->batch_size = 0;
+}
+
+static void emitter_draw_streams(emitter_t *self, video_t *video) {
+    for (size_t first = 0; first < self->size; first += EMITTER_CHUNK_SIZE) {
+        size_t count = MIN(self->size - first, EMITTER_CHUNK_SIZE);
+        size_t position = video_data_write(video, 1, self->position + 2 * first, 2 * count * sizeof(float), 4 * sizeof(float));
+        size_t color = video_data_write(video, 1, self->color + 4 * first, 4 * count * sizeof(float), 4 * sizeof(float));
+        video_env_instances(video, video->env, position, color, 0);
+        glDrawArraysInstancedANGLE(GL_TRIANGLE_FAN, video->batch_first, 4, (GLsizei) count);
+        video->stats_frame.commands++;
+        video->stats_frame.draws++;
+    }
+}
+
+static void emitter_upload_run(emitter_t *self, video_t *video, size_t first) {
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, first * EMITTER_GPU_STRIDE * sizeof(float), video->buffer_size * sizeof(float), video->buffer);
+    video->stats_frame.uploads++;
+    video->stats_frame.bytes += video->buffer_size * sizeof(float);
+    video_data_clear(video);
+}
+
+static void emitter_upload(emitter_t *self, video_t *video) {
+    if (!self->particles->size) {
+        return;
+    }
+    size_t first = self->head;
+    size_t skip = self->particles->size > self->capacity ? self->particles->size - self->capacity : 0;
+    video_data_clear(video);
     iterator_t iterator = array_iterator(self->particles);
     while (iterator_has_next(iterator)) {
         particle_t *particle = iterator_next(iterator);
-        if (particle->lifetime > 0) {
-            particle->position = vec2_add(particle->position, particle->velocity);
-            particle->lifetime--;
-        } else {
-            iterator_remove(iterator);
+        if (skip) {
+            skip--;
+            continue;
+        }
+        int lifetime = MIN(particle->lifetime, EMITTER_GPU_WRAP - 1);
+        video_data_put4(video, particle->position.x, particle->position.y, particle->velocity.x, particle->velocity.y);
+        video_data_put4(video, particle->color.x, particle->color.y, particle->color.z, particle->color.w);
+        video_data_put2(video, particle->spawn % EMITTER_GPU_WRAP, lifetime);
+        self->expiry = MAX(self->expiry, particle->spawn + lifetime);
+        self->head = (self->head + 1) % self->capacity;
+        if (!self->head || video->buffer_size + EMITTER_GPU_STRIDE > VIDEO_BUFFER_SIZE) {
+            emitter_upload_run(self, video, first);
+            first = self->head;
         }
     }
+    if (video->buffer_size) {
+        emitter_upload_run(self, video, first);
+    }
+    self->size = MIN(self->size + self->particles->size, self->capacity);
+    self->particles->size = 0;
+}
+
+static void emitter_draw_gpu(emitter_t *self, video_t *video) {
+    video_env_t *env = video->env;
+    size_t stride = EMITTER_GPU_STRIDE * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo);
+    glVertexAttribPointer(env->attrib_instance_offset, 2, GL_FLOAT, GL_FALSE, (GLsizei) stride, NULL);
+    glVertexAttribPointer(env->attrib_instance_velocity, 2, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (2 * sizeof(float)));
+    glVertexAttribPointer(env->attrib_instance_color, 4, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (4 * sizeof(float)));
+    glVertexAttribPointer(env->attrib_instance_time, 2, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (8 * sizeof(float)));
+    glUniform1f(env->uniform_time, (float) (self->time % EMITTER_GPU_WRAP));
+    video->stats_frame.uniforms++;
+    glDrawArraysInstancedANGLE(GL_TRIANGLE_FAN, video->batch_first, 4, (GLsizei) self->size);
+    video->stats_frame.commands++;
+    video->stats_frame.draws++;
+}
+
+static video_env_t *emitter_env(emitter_t *self, video_t *video) {
+    if (self->mode == EMITTER_GPU) {
+        return self->sprite ? &video->env_particles_gpu_textured : &video->env_particles_gpu;
+    }
+    return self->sprite ? &video->env_particles_textured : &video->env_particles;
 }
 
 void emitter_draw(emitter_t *self, video_t *video) {
+    video_cfg_t *cfg = array_get_last(video->configs);
+    video_env_t *env = emitter_env(self, video);
+    size_t stride = self->sprite ? 4 * sizeof(float) : 2 * sizeof(float);
+    emitter_commit(self);
+    if (self->mode == EMITTER_GPU) {
+        emitter_upload(self, video);
+        if (self->time > self->expiry) {
+            self->size = 0;
+            self->head = 0;
+            return;
+        }
+    }
+    video_flush(video);
+    video_env_use(video, env, cfg->tint);
     video_data_clear(video);
     if (self->sprite) {
-        video_env_set(video, &video->env_particles_textured);
         sprite_t *sprite = self->sprite;
+        float s_min = (float) sprite->x / sprite->tex_w;
+        float s_max = (float) (sprite->x + sprite->w) / sprite->tex_w;
+        float t_min = (float) sprite->y / sprite->tex_h;
+        float t_max = (float) (sprite->y + sprite->h) / sprite->tex_h;
         glBindTexture(GL_TEXTURE_2D, sprite->texture);
-        video_data_put4(video, 0, 0, 0, 0);
-        video_data_put4(video, sprite->w, 0, 1, 0);
-        video_data_put4(video, sprite->w, sprite->h, 1, 1);
-        video_data_put4(video, 0, sprite->h, 0, 1);
+        video->stats_frame.binds++;
+        video_data_put4(video, 0, 0, s_min, t_min);
+        video_data_put4(video, sprite->w, 0, s_max, t_min);
+        video_data_put4(video, sprite->w, sprite->h, s_max, t_max);
+        video_data_put4(video, 0, sprite->h, s_min, t_max);
     } else {
-        video_env_set(video, &video->env_particles);
         video_data_put2(video, 0, 0);
         video_data_put2(video, 5, 0);
         video_data_put2(video, 5, 5);
         video_data_put2(video, 0, 5);
     }
-    video_data_send(video, 0);
-    int count = 0;
+    video->batch_first = (GLint) (video_data_send(video, 0, stride) / stride);
+    if (self->mode == EMITTER_SOA) {
+        emitter_draw_streams(self, video);
+        return;
+    }
+    if (self->mode == EMITTER_GPU) {
+        emitter_draw_gpu(self, video);
+        return;
+    }
+    video->batch_size = 0;
+    video->batch_flush = emitter_flush;
     video_data_clear(video);
     iterator_t iterator = array_iterator(self->particles);
     while (iterator_has_next(iterator)) {
         particle_t *particle = iterator_next(iterator);
+        video_data_reserve(video, 6);
         video_data_put2(video, particle->position.x, particle->position.y);
         video_data_put4(video, particle->color.x, particle->color.y, particle->color.z, particle->color.w);
-        count++;
+        video->batch_size++;
     }
-    video_data_send(video, 1);
-    glDrawArraysInstancedANGLE(GL_TRIANGLE_FAN, 0, 4, count);
+    emitter_flush(video);
+    video->batch_flush = NULL;
 }
 
 void emitter_delete(emitter_t *self) {
     array_delete(self->particles);
+    free(self->position);
+    free(self->velocity);
+    free(self->color);
+    free(self->lifetime);
+    if (self->vbo) {
+        glDeleteBuffers(1, &self->vbo);
+    }
     free(self);
-}
\ No newline at end of file
+}
@@ -0,0 +1,165 @@
+#include "../include/profiler.h"
+#include "../include/ctx.h"
+#include "video_private.h"
+
+#define PROFILER_QUERIES 4
+#define PROFILER_AVERAGE 60
+#define PROFILER_LINE 16.0f
+#define PROFILER_GRAPH_MS 33.3f
+#define PROFILER_GRAPH_HEIGHT 64.0f
+
+struct profiler_t {
+    Uint64 start[PROFILER_PHASES];
+    float phases[PROFILER_PHASES][PROFILER_HISTORY];
+    float frames[PROFILER_HISTORY];
+    float gpu[PROFILER_HISTORY];
+    int index;
+    int count;
+    Uint64 frame_last;
+    bool timer_query;
+    bool query_active;
+    GLuint queries[PROFILER_QUERIES];
+    unsigned int query_head;
+    unsigned int query_tail;
+    float gpu_last;
+};
+
+static float profiler_ms(Uint64 ticks) {
+    return (float) ((double) ticks * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static float profiler_average(profiler_t *self, const float *history) {
+    int count = MIN(self->count, PROFILER_AVERAGE);
+    float sum = 0.0f;
+    for (int i = 1; i <= count; i++) {
+        sum += history[(self->index + PROFILER_HISTORY - i) % PROFILER_HISTORY];
+    }
+    return count ? sum / count : 0.0f;
+}
+
+profiler_t *profiler_new() {
+    profiler_t *self = malloc_ext(sizeof(*self));
+    memset(self, 0, sizeof(*self));
+    self->frame_last = SDL_GetPerformanceCounter();
+#ifndef __EMSCRIPTEN__
+    self->timer_query = epoxy_is_desktop_gl() && (epoxy_gl_version() >= 33 || epoxy_has_gl_extension("GL_ARB_timer_query"));
+    if (self->timer_query) {
+        glGenQueries(PROFILER_QUERIES, self->queries);
+    }
+#endif
+    return self;
+}
+
+void profiler_begin(profiler_t *self, profiler_phase phase) {
+    self->start[phase] = SDL_GetPerformanceCounter();
+}
+
+void profiler_end(profiler_t *self, profiler_phase phase) {
+    self->phases[phase][self->index] += profiler_ms(SDL_GetPerformanceCounter() - self->start[phase]);
+}
+
+void profiler_gpu_begin(profiler_t *self) {
+#ifndef __EMSCRIPTEN__
+    if (!self->timer_query || self->query_head - self->query_tail >= PROFILER_QUERIES) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, self->queries[self->query_head % PROFILER_QUERIES]);
+    self->query_active = true;
+#endif
+}
+
+void profiler_gpu_end(profiler_t *self) {
+#ifndef __EMSCRIPTEN__
+    if (!self->query_active) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    self->query_head++;
+    self->query_active = false;
+#endif
+}
+
+void profiler_frame(profiler_t *self) {
+#ifndef __EMSCRIPTEN__
+    while (self->query_tail != self->query_head) {
+        GLuint query = self->queries[self->query_tail % PROFILER_QUERIES];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        self->gpu_last = (float) (elapsed / 1000000.0);
+        self->query_tail++;
+    }
+#endif
+    Uint64 now = SDL_GetPerformanceCounter();
+    self->frames[self->index] = profiler_ms(now - self->frame_last);
+    self->gpu[self->index] = self->gpu_last;
+    self->frame_last = now;
+    self->index = (self->index + 1) % PROFILER_HISTORY;
+    self->count = MIN(self->count + 1, PROFILER_HISTORY);
+    for (int i = 0; i < PROFILER_PHASES; i++) {
+        self->phases[i][self->index] = 0.0f;
+    }
+}
+
+void profiler_draw(profiler_t *self, video_t *video, font_t *font, float x, float y) {
+    video_cfg_t *cfg = array_get_last(video->configs);
+    video_cfg_t saved = *cfg;
+    arena_t *arena = ctx_arena();
+    video_stats_t stats = video_stats(video);
+    float frame = profiler_average(self, self->frames);
+    video_cfg_mode(video, VIDEO_FILL);
+    video_cfg_color(video, vec4_new(0, 0, 0, 0.75f));
+    video_rectangle(video, x, y, PROFILER_HISTORY + 16, 6 * PROFILER_LINE + PROFILER_GRAPH_HEIGHT + 24);
+    video_cfg_color(video, vec4_new(1, 1, 1, 1));
+    x += 8;
+    y += 8;
+    video_text(video, font, arena_printf(arena, "frame %.2f ms (%.0f fps)", frame, frame > 0.0f ? 1000.0f / frame : 0.0f), x, y);
+    y += PROFILER_LINE;
+    video_text(video, font, arena_printf(arena, "events %.2f tick %.2f draw %.2f swap %.2f",
+                                         profiler_average(self, self->phases[PROFILER_EVENTS]),
+                                         profiler_average(self, self->phases[PROFILER_TICK]),
+                                         profiler_average(self, self->phases[PROFILER_DRAW]),
+                                         profiler_average(self, self->phases[PROFILER_SWAP])), x, y);
+    y += PROFILER_LINE;
+    if (self->timer_query) {
+        video_text(video, font, arena_printf(arena, "gpu %.2f ms", profiler_average(self, self->gpu)), x, y);
+    } else {
+        video_text(video, font, "gpu n/a", x, y);
+    }
+    y += PROFILER_LINE;
+    video_text(video, font, arena_printf(arena, "draws %llu commands %llu", (unsigned long long) stats.draws, (unsigned long long) stats.commands), x, y);
+    y += PROFILER_LINE;
+    video_text(video, font, arena_printf(arena, "envs %llu binds %llu uniforms %llu", (unsigned long long) stats.env_switches, (unsigned long long) stats.binds, (unsigned long long) stats.uniforms), x, y);
+    y += PROFILER_LINE;
+    video_text(video, font, arena_printf(arena, "uploads %llu bytes %llu stalls %llu", (unsigned long long) stats.uploads, (unsigned long long) stats.bytes, (unsigned long long) stats.stalls), x, y);
+    y += PROFILER_LINE + 8;
+    float bottom = y + PROFILER_GRAPH_HEIGHT;
+    for (int i = 0; i < self->count; i++) {
+        float ms = self->frames[(self->index + PROFILER_HISTORY - self->count + i) % PROFILER_HISTORY];
+        float h = MIN(ms / PROFILER_GRAPH_MS, 1.0f) * PROFILER_GRAPH_HEIGHT;
+        if (ms > 33.4f) {
+            video_cfg_color(video, vec4_new(1, 0.25f, 0.25f, 1));
+        } else if (ms > 16.7f) {
+            video_cfg_color(video, vec4_new(1, 1, 0.25f, 1));
+        } else {
+            video_cfg_color(video, vec4_new(0.25f, 1, 0.25f, 1));
+        }
+        video_rectangle(video, x + i, bottom - h, 1, h);
+    }
+    video_cfg_color(video, vec4_new(1, 1, 1, 0.5f));
+    video_rectangle(video, x, bottom - 16.7f / PROFILER_GRAPH_MS * PROFILER_GRAPH_HEIGHT, PROFILER_HISTORY, 1);
+    *cfg = saved;
+}
+
+void profiler_delete(profiler_t *self) {
+#ifndef __EMSCRIPTEN__
+    if (self->timer_query) {
+        glDeleteQueries(PROFILER_QUERIES, self->queries);
+    }
+#endif
+    free(self);
+}
@@ -4,7 +4,6 @@
 
 static audio_t *audio;
 static unsigned long long money = 0;
-static char buffer[1024];
 static font_t *font_proggy_clean;
 static int money_timer;
 static int news_timer;
@@ -16,6 +15,12 @@ static sound_t *sound_cash;
 static sprite_t *particle_usb;
 
 static emitter_t *emitter;
+static emitter_t *emitter_gpu;
+static atlas_t *atlas;
+static text_t *label_money;
+static text_t *label_news;
+static video_mesh_t *mesh_panel;
+static bool loaded;
 
 typedef struct {
     char *name;
@@ -23,6 +28,8 @@ typedef struct {
     int income;
     int count;
     sprite_t *sprite;
+    text_t *label;
+    text_t *price;
 } upgrade_t;
 
 static upgrade_t upgrades[] = {
@@ -107,6 +114,40 @@ static char *messages[] = {
 
 static char *news_message = NULL;
 
+#define ECONOMY_PERIOD 60
+#define NEWS_PERIOD 500
+#define CAM_PERIOD 20
+#define STRESS_GLYPHS 1000000
+#define STRESS_PARTICLES 1000000
+#define STRESS_LINE 100
+#define STRESS_GPU_RATE 256
+
+static unsigned long long economy_income() {
+    unsigned long long income = 0;
+    for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
+        income += (unsigned long long) upgrades[i].count * upgrades[i].income;
+    }
+    return income;
+}
+
+static void economy_advance_ticks(unsigned long long ticks) {
+    unsigned long long total = money_timer + ticks;
+    money += total / ECONOMY_PERIOD * economy_income();
+    money_timer = (int) (total % ECONOMY_PERIOD);
+}
+
+static double economy_time_until(upgrade_t *upgrade) {
+    if (money >= upgrade->cost) {
+        return 0.0;
+    }
+    unsigned long long income = economy_income();
+    if (!income) {
+        return -1.0;
+    }
+    unsigned long long payouts = (upgrade->cost - money + income - 1) / income;
+    return (double) (payouts * ECONOMY_PERIOD - money_timer) / CTX_TICK_RATE;
+}
+
 static void on_mouse_click(vec2_t pos) {
     for (int i = 0; i < 32; i++) {
         particle_t *particle = emitter_emit(emitter, pos.x, pos.y);
@@ -119,7 +160,9 @@ static void on_mouse_click(vec2_t pos) {
         if (vec4_point_inside(rect, pos)) {
             if (upgrades[i].cost <= money) {
                 upgrades[i].count++;
-                audio_sound_play(audio, sound_cash);
+                if (sound_cash) {
+                    audio_sound_play(audio, sound_cash);
+                }
                 money -= upgrades[i].cost;
             }
             return;
@@ -129,81 +172,194 @@ static void on_mouse_click(vec2_t pos) {
 }
 
 static void sketch_init() {
-    font_proggy_clean = font_load("asset/font/proggy_clean.fnt", "asset/font/proggy_clean.png");
-    sprite_cam[0] = sprite_load("asset/sprite/cam0.png");
-    sprite_cam[1] = sprite_load("asset/sprite/cam1.png");
-    sprite_cam[2] = sprite_load("asset/sprite/cam2.png");
-    upgrades[0].sprite = sprite_load("asset/sprite/icon_wiring_plan.png");
-    upgrades[1].sprite = sprite_load("asset/sprite/icon_xbox_controller.png");
-    upgrades[2].sprite = sprite_load("asset/sprite/icon_gamestop.png");
-    upgrades[3].sprite = sprite_load("asset/sprite/icon_fritzbox.png");
-    upgrades[4].sprite = sprite_load("asset/sprite/icon_home_automation.png");
-    upgrades[5].sprite = sprite_load("asset/sprite/icon_copy_paste.png");
-    upgrades[6].sprite = sprite_load("asset/sprite/icon_usb_d.png");
-    upgrades[7].sprite = sprite_load("asset/sprite/icon_open_licht.png");
+    atlas = atlas_new(2048, 1024);
+    font_proggy_clean = font_load_atlas_async(atlas, "asset/font/proggy_clean.fnt", "asset/font/proggy_clean.png");
+    sprite_cam[0] = atlas_add_async(atlas, "asset/sprite/cam0.png");
+    sprite_cam[1] = atlas_add_async(atlas, "asset/sprite/cam1.png");
+    sprite_cam[2] = atlas_add_async(atlas, "asset/sprite/cam2.png");
+    upgrades[0].sprite = atlas_add_async(atlas, "asset/sprite/icon_wiring_plan.png");
+    upgrades[1].sprite = atlas_add_async(atlas, "asset/sprite/icon_xbox_controller.png");
+    upgrades[2].sprite = atlas_add_async(atlas, "asset/sprite/icon_gamestop.png");
+    upgrades[3].sprite = atlas_add_async(atlas, "asset/sprite/icon_fritzbox.png");
+    upgrades[4].sprite = atlas_add_async(atlas, "asset/sprite/icon_home_automation.png");
+    upgrades[5].sprite = atlas_add_async(atlas, "asset/sprite/icon_copy_paste.png");
+    upgrades[6].sprite = atlas_add_async(atlas, "asset/sprite/icon_usb_d.png");
+    upgrades[7].sprite = atlas_add_async(atlas, "asset/sprite/icon_open_licht.png");
+    particle_usb = atlas_add_async(atlas, "asset/sprite/particle_usb.png");
     news_message = messages[rand() % ARRAY_LENGTH(messages)];
-    ctx_hook_mouse(on_mouse_click);
     audio = ctx_audio();
-    sound_cash = audio_load_sound(audio, "asset/sound/cash.wav");
-    particle_usb = sprite_load("asset/sprite/particle_usb.png");
-    emitter = emitter_new(particle_usb);
+    sound_cash = audio_load_sound_async(audio, "asset/sound/cash.wav");
+    if (sound_cash) {
+        sound_cash->polyphony = 8;
+    }
+    video_cfg_deferred(ctx_video(), true);
+    video_cfg_instanced(ctx_video(), true);
+}
+
+static void sketch_ready(video_t *video) {
+    mesh_panel = video_mesh_begin(video);
+    video_cfg_mode(video, VIDEO_STROKE);
+    video_cfg_color(video, vec4_new(0.5, 0.5, 0.5, 1));
+    for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
+        if (sprite_ready(upgrades[i].sprite)) {
+            video_sprite(video, upgrades[i].sprite, 630, 10 + i * 72);
+        } else {
+            video_rectangle(video, 630, 10 + i * 72, 64, 64);
+        }
+        video_rectangle(video, 714, 40 + i * 72, 200, 32);
+    }
+    video_mesh_end(video, mesh_panel);
+    video_cfg_mode(video, VIDEO_FILL);
+    video_cfg_color(video, vec4_new(1, 1, 1, 1));
+    label_money = text_new(font_proggy_clean, 10, 10);
+    label_news = text_new(font_proggy_clean, 10, 730);
+    for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
+        upgrades[i].label = text_new(font_proggy_clean, 714, 10 + i * 72);
+        upgrades[i].price = text_new(font_proggy_clean, 719, 45 + i * 72);
+    }
+    emitter = emitter_new_ext(particle_usb, EMITTER_SOA);
+    ctx_hook_mouse(on_mouse_click);
+    ctx_profiler_font(font_proggy_clean);
 }
 
 static void sketch_tick() {
-    money_timer++;
+    if (!loaded) {
+        return;
+    }
     news_timer++;
     cam_timer++;
-    if (money_timer >= 60) {
-        for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
-            money += upgrades[i].count * upgrades[i].income;
-        }
-        money_timer = 0;
-    }
-    if (news_timer >= 500) {
+    economy_advance_ticks(1);
+    if (news_timer >= NEWS_PERIOD) {
         news_message = messages[rand() % ARRAY_LENGTH(messages)];
         news_timer = 0;
     }
-    if (cam_timer >= 20) {
+    if (cam_timer >= CAM_PERIOD) {
         cam_index = (cam_index + 1) % ARRAY_LENGTH(sprite_cam);
         cam_timer = 0;
     }
     emitter_tick(emitter);
 }
 
-static void sketch_draw(video_t *video) {
-    sprintf(buffer, "C4$h: %llu$", money);
-    video_text(video, font_proggy_clean, buffer, 10, 10);
+static void sketch_advance(double seconds) {
+    unsigned long long ticks = (unsigned long long) (seconds * CTX_TICK_RATE + 0.5);
+    economy_advance_ticks(ticks);
+    if (news_timer + ticks >= NEWS_PERIOD) {
+        news_message = messages[rand() % ARRAY_LENGTH(messages)];
+    }
+    news_timer = (int) ((news_timer + ticks) % NEWS_PERIOD);
+    cam_index = (int) ((cam_index + (cam_timer + ticks) / CAM_PERIOD) % ARRAY_LENGTH(sprite_cam));
+    cam_timer = (int) ((cam_timer + ticks) % CAM_PERIOD);
+}
+
+static void sketch_draw(video_t *video, float alpha) {
+    if (!loaded) {
+        loaded = atlas_build_async(atlas);
+        if (!loaded) {
+            video_cfg_mode(video, VIDEO_STROKE);
+            video_rectangle(video, 440, 372, 400, 24);
+            video_cfg_mode(video, VIDEO_FILL);
+            video_rectangle(video, 444, 376, 392 * atlas_progress(atlas), 16);
+            return;
+        }
+        sketch_ready(video);
+    }
+    arena_t *arena = ctx_arena();
+    text_set(label_money, arena_printf(arena, "C4$h: %llu$", money));
+    video_text_run(video, label_money);
     video_sprite(video, sprite_cam[cam_index], 10, 40);
-    video_cfg_mode(video, VIDEO_STROKE);
+    for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
+        vec4_t color = money >= upgrades[i].cost ? vec4_new(1, 1, 1, 1) : vec4_new(0.5, 0.5, 0.5, 1);
+        video_mesh_color(mesh_panel, 2 * i, color);
+        video_mesh_color(mesh_panel, 2 * i + 1, color);
+    }
+    video_mesh_draw(video, mesh_panel);
     for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
         if (money >= upgrades[i].cost) {
             video_cfg_color(video, vec4_new(1, 1, 1, 1));
         } else {
             video_cfg_color(video, vec4_new(0.5, 0.5, 0.5, 1));
         }
-        sprintf(buffer, "%dx %s", upgrades[i].count, upgrades[i].name);
-        if (upgrades[i].sprite) {
-            video_sprite(video, upgrades[i].sprite, 630, 10 + i * 72);
+        text_set(upgrades[i].label, arena_printf(arena, "%dx %s", upgrades[i].count, upgrades[i].name));
+        video_text_run(video, upgrades[i].label);
+        double wait = economy_time_until(&upgrades[i]);
+        if (wait > 0.0) {
+            text_set(upgrades[i].price, arena_printf(arena, "%d$ in %.0fs", upgrades[i].cost, wait));
         } else {
-            video_rectangle(video, 630, 10 + i * 72, 64, 64);
+            text_set(upgrades[i].price, arena_printf(arena, "%d$", upgrades[i].cost));
         }
-        video_text(video, font_proggy_clean, buffer, 714, 10 + i * 72);
-        video_rectangle(video, 714, 40 + i * 72, 200, 32);
-        sprintf(buffer, "%d$", upgrades[i].cost);
-        video_text(video, font_proggy_clean, buffer, 719, 45 + i * 72);
+        video_text_run(video, upgrades[i].price);
     }
     video_cfg_color(video, vec4_new(1, 0.5, 0.5, 1));
     if (news_message) {
-        sprintf(buffer, "NEWS: %s", news_message);
-        video_text(video, font_proggy_clean, buffer, 10, 730);
+        text_set(label_news, arena_printf(arena, "NEWS: %s", news_message));
+        video_text_run(video, label_news);
     }
     video_cfg_color(video, vec4_new(1, 1, 1, 1));
     emitter_draw(emitter, video);
 }
 
 static void sketch_shutdown() {
+    if (loaded) {
+        emitter_delete(emitter);
+        video_mesh_delete(mesh_panel);
+        for (int i = 0; i < ARRAY_LENGTH(upgrades); i++) {
+            text_delete(upgrades[i].label);
+            text_delete(upgrades[i].price);
+        }
+        text_delete(label_money);
+        text_delete(label_news);
+    }
+    if (sound_cash) {
+        audio_sound_delete(sound_cash);
+    }
+    font_delete(font_proggy_clean);
+    atlas_delete(atlas);
+}
+
+static void stress_init() {
+    font_proggy_clean = font_load("asset/font/proggy_clean.fnt", "asset/font/proggy_clean.png");
+    particle_usb = sprite_load("asset/sprite/particle_usb.png");
+    emitter = emitter_new_ext(particle_usb, EMITTER_SOA);
+    for (int i = 0; i < STRESS_PARTICLES; i++) {
+        particle_t *particle = emitter_emit(emitter, random_float(0, 1280), random_float(0, 768));
+        particle->color = COLOR_RGB_RANDOM;
+        particle->velocity.x = random_gaussian();
+        particle->velocity.y = random_gaussian();
+        particle->lifetime = INT32_MAX;
+    }
+    emitter_gpu = emitter_new_ext(particle_usb, EMITTER_GPU);
+    video_cfg_deferred(ctx_video(), true);
+    video_cfg_instanced(ctx_video(), true);
+}
+
+static void stress_tick() {
+    for (int i = 0; i < STRESS_GPU_RATE; i++) {
+        particle_t *particle = emitter_emit(emitter_gpu, random_float(0, 1280), random_float(0, 768));
+        particle->color = COLOR_RGB_RANDOM;
+        particle->velocity.x = random_gaussian();
+        particle->velocity.y = random_gaussian();
+    }
+    emitter_tick(emitter);
+    emitter_tick(emitter_gpu);
+}
+
+static void stress_draw(video_t *video, float alpha) {
+    char line[STRESS_LINE + 1];
+    for (int i = 0; i < STRESS_LINE; i++) {
+        line[i] = (char) ('!' + i % 94);
+    }
+    line[STRESS_LINE] = '\0';
+    for (int i = 0; i < STRESS_GLYPHS / STRESS_LINE; i++) {
+        video_text(video, font_proggy_clean, line, (float) (i / 96 % 2) * 640, (float) (i % 96) * 8);
+    }
+    emitter_draw(emitter, video);
+    emitter_draw(emitter_gpu, video);
+}
+
+static void stress_shutdown() {
     emitter_delete(emitter);
-    audio_sound_delete(sound_cash);
+    emitter_delete(emitter_gpu);
+    sprite_delete(particle_usb);
     font_delete(font_proggy_clean);
 }
 
@@ -212,7 +368,18 @@ int main(int argc, char **argv) {
             .init = sketch_init,
             .tick = sketch_tick,
             .draw = sketch_draw,
-            .shutdown = sketch_shutdown
+            .shutdown = sketch_shutdown,
+            .advance = sketch_advance
     };
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--stress")) {
+            sketch = (sketch_t) {
+                    .init = stress_init,
+                    .tick = stress_tick,
+                    .draw = stress_draw,
+                    .shutdown = stress_shutdown
+            };
+        }
+    }
     return ctx_main(argc, argv, &sketch);
 }
@@ -1,5 +1,14 @@
 #include "video_private.h"
 
+static pool_t *sprite_pool;
+
+static sprite_t *sprite_new() {
+    if (!sprite_pool) {
+        sprite_pool = pool_new(sizeof(sprite_t));
+    }
+    return pool_alloc(sprite_pool);
+}
+
 sprite_t *sprite_load(const char *filename) {
     char *ext = strstr(filename, ".");
     if (!strcmp(ext, ".dds")) {
@@ -8,26 +17,40 @@ sprite_t *sprite_load(const char *filename) {
     return sprite_load_img(filename);
 }
 
-sprite_t *sprite_load_img(const char *filename) {
+SDL_Surface *sprite_surface_load(const char *filename) {
     SDL_Surface *src = IMG_Load(filename);
     if (!src) {
         return NULL;
     }
     SDL_Surface *dst = SDL_ConvertSurfaceFormat(src, SDL_PIXELFORMAT_RGBA32, 0);
     SDL_FreeSurface(src);
+    return dst;
+}
+
+void sprite_texture_params() {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+sprite_t *sprite_load_img(const char *filename) {
+    SDL_Surface *dst = sprite_surface_load(filename);
     if (!dst) {
         return NULL;
     }
-    sprite_t *self = malloc_ext(sizeof(*self));
+    sprite_t *self = sprite_new();
     glGenTextures(1, &self->texture);
     glBindTexture(GL_TEXTURE_2D, self->texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dst->w, dst->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, dst->pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    sprite_texture_params();
     self->w = dst->w;
     self->h = dst->h;
+    self->x = 0;
+    self->y = 0;
+    self->tex_w = dst->w;
+    self->tex_h = dst->h;
+    self->atlas = NULL;
     SDL_FreeSurface(dst);
     return self;
 }
@@ -73,7 +96,7 @@ sprite_t *sprite_load_dds(const char *filename) {
     char *buffer = malloc_ext(buffer_size * sizeof(char));
     fread(buffer, sizeof(char), buffer_size, file);
     fclose(file);
-    sprite_t *self = malloc_ext(sizeof(*self));
+    sprite_t *self = sprite_new();
     glGenTextures(1, &self->texture);
     glBindTexture(GL_TEXTURE_2D, self->texture);
     if (header.mip_map_count > 0) {
@@ -90,42 +113,79 @@ sprite_t *sprite_load_dds(const char *filename) {
     } else {
         glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, header.w, header.h, 0, (GLsizei) buffer_size, buffer);
     }
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    sprite_texture_params();
     self->w = header.w;
     self->h = header.h;
+    self->x = 0;
+    self->y = 0;
+    self->tex_w = header.w;
+    self->tex_h = header.h;
+    self->atlas = NULL;
     free(buffer);
     return self;
 }
 
+static void video_sprite_flush(video_t *self) {
+    if (self->batch_size && self->batch_env == &self->env_sprite_instanced) {
+        video_data_draw(self, GL_TRIANGLE_STRIP, self->batch_size);
+    } else if (self->batch_size) {
+        video_data_draw(self, GL_TRIANGLES, 6 * self->batch_size);
+    }
+    video_data_clear(self);
+    self->batch_size = 0;
+}
+
 void video_sprite_begin(video_t *self, sprite_t *sprite) {
-    video_env_set(self, &self->env_textured);
+    video_cfg_t *cfg = array_get_last(self->configs);
+    bool instanced = self->instanced && video_transform_aligned(cfg->transform);
+    video_env_set(self, instanced ? &self->env_sprite_instanced : &self->env_textured);
     video_data_clear(self);
     self->batch_size = 0;
-    self->batch_sx = 1.0f / sprite->w;
-    self->batch_sy = 1.0f / sprite->h;
-    glBindTexture(GL_TEXTURE_2D, sprite->texture);
+    self->batch_flush = video_sprite_flush;
+    self->batch_sx = 1.0f / sprite->tex_w;
+    self->batch_sy = 1.0f / sprite->tex_h;
+    self->batch_ox = sprite->x;
+    self->batch_oy = sprite->y;
+    self->batch_texture = sprite->texture;
+    if (!self->deferred) {
+        glBindTexture(GL_TEXTURE_2D, sprite->texture);
+        self->stats_frame.binds++;
+    }
 }
 
 void video_sprite_item(video_t *self, vec4_t dst, vec4_t src) {
-    float s_min = self->batch_sx * src.x;
-    float s_max = self->batch_sx * (src.x + src.z);
-    float t_min = self->batch_sy * src.y;
-    float t_max = self->batch_sy * (src.y + src.w);
+    video_cfg_t *cfg = array_get_last(self->configs);
+    float s_min = self->batch_sx * (self->batch_ox + src.x);
+    float s_max = self->batch_sx * (self->batch_ox + src.x + src.z);
+    float t_min = self->batch_sy * (self->batch_oy + src.y);
+    float t_max = self->batch_sy * (self->batch_oy + src.y + src.w);
+    if (self->batch_env == &self->env_sprite_instanced) {
+        video_data_reserve(self, 9);
+        video_data_put4(self, dst.x, dst.y, dst.z, dst.w);
+        video_data_put4(self, s_min, t_min, s_max, t_max);
+        video_data_put_color(self, cfg->packed);
+        self->batch_size++;
+        return;
+    }
+    video_data_reserve(self, 30);
     video_data_put4(self, dst.x, dst.y + dst.w, s_min, t_max);
+    video_data_put_color(self, cfg->packed);
     video_data_put4(self, dst.x, dst.y, s_min, t_min);
+    video_data_put_color(self, cfg->packed);
     video_data_put4(self, dst.x + dst.z, dst.y, s_max, t_min);
+    video_data_put_color(self, cfg->packed);
     video_data_put4(self, dst.x, dst.y + dst.w, s_min, t_max);
+    video_data_put_color(self, cfg->packed);
     video_data_put4(self, dst.x + dst.z, dst.y, s_max, t_min);
+    video_data_put_color(self, cfg->packed);
     video_data_put4(self, dst.x + dst.z, dst.y + dst.w, s_max, t_max);
+    video_data_put_color(self, cfg->packed);
     self->batch_size++;
 }
 
 void video_sprite_end(video_t *self) {
-    video_data_send(self, 0);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei) (6 * self->batch_size));
+    video_sprite_flush(self);
+    self->batch_flush = NULL;
 }
 
 void video_sprite(video_t *self, sprite_t *sprite, float x, float y) {
@@ -140,7 +200,18 @@ void video_sprite_ext(video_t *self, sprite_t *sprite, vec4_t dst, vec4_t src) {
     video_sprite_end(self);
 }
 
+bool sprite_ready(sprite_t *self) {
+    return self->texture != 0;
+}
+
 void sprite_delete(sprite_t *self) {
+    if (self->atlas) {
+        return;
+    }
     glDeleteTextures(1, &self->texture);
-    free(self);
+    pool_free(sprite_pool, self);
+    if (!sprite_pool->size) {
+        pool_delete(sprite_pool);
+        sprite_pool = NULL;
+    }
 }
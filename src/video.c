@@ -1,77 +1,230 @@
 #include "video_private.h"
 #include "../include/ctx.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define VIDEO_HASH_OFFSET 14695981039346656037ULL
+#define VIDEO_HASH_PRIME 1099511628211ULL
 
-static GLuint video_shader_load(GLenum type, const char *filename) {
-    char *buffer = malloc_ext(1024 * sizeof(char));
-    if (!file_read(filename, buffer, 1024)) {
-        free(buffer);
-        return 0;
+static uint64_t video_hash(uint64_t hash, const char *str) {
+    for (; *str; str++) {
+        hash = (hash ^ (uint8_t) *str) * VIDEO_HASH_PRIME;
     }
+    return hash;
+}
+
+static GLuint video_shader_load(GLenum type, const char *filename, const char *source) {
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, (const char**) &buffer, NULL);
+    glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
 #ifdef DEBUG
     GLint status;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     if (!status) {
-        glGetShaderInfoLog(shader, 1024 * sizeof(char), NULL, buffer);
+        char buffer[1024];
+        glGetShaderInfoLog(shader, sizeof(buffer), NULL, buffer);
         printf("%s: %s\n", filename, buffer);
     }
 #endif
-    free(buffer);
     return shader;
 }
 
+#ifndef __EMSCRIPTEN__
+static bool video_program_cached(GLuint program, const char *path) {
+    size_t size;
+    char *data = file_read_all(path, &size);
+    if (!data) {
+        return false;
+    }
+    GLint status = GL_FALSE;
+    if (size > sizeof(uint32_t)) {
+        uint32_t format;
+        memcpy(&format, data, sizeof(format));
+        glProgramBinary(program, format, data + sizeof(format), (GLsizei) (size - sizeof(format)));
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+    }
+    free(data);
+    return status == GL_TRUE;
+}
+
+static void video_program_store(GLuint program, const char *path) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    char *data = malloc_ext(sizeof(uint32_t) + length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, data + sizeof(uint32_t));
+    uint32_t stored = format;
+    memcpy(data, &stored, sizeof(stored));
+    FILE *file = fopen(path, "wb");
+    if (file) {
+        fwrite(data, 1, sizeof(uint32_t) + length, file);
+        fclose(file);
+    }
+#ifdef DEBUG
+    else {
+        printf("video_program_store: cannot write %s\n", path);
+    }
+#endif
+    free(data);
+}
+#endif
+
+static GLuint video_program_load(video_t *self, const char *filename_frag, const char *filename_vert) {
+    GLuint program = glCreateProgram();
+    char *source_frag = file_read_all(filename_frag, NULL);
+    char *source_vert = file_read_all(filename_vert, NULL);
+    if (!source_frag || !source_vert) {
+        free(source_frag);
+        free(source_vert);
+        return program;
+    }
+    char *path = NULL;
+#ifndef __EMSCRIPTEN__
+    if (self->shader_cache) {
+        uint64_t hash = video_hash(video_hash(self->shader_hash, source_frag), source_vert);
+        size_t size = strlen(self->shader_cache) + 24;
+        path = malloc_ext(size);
+        snprintf(path, size, "%s%016llx.bin", self->shader_cache, (unsigned long long) hash);
+        if (video_program_cached(program, path)) {
+            free(path);
+            free(source_frag);
+            free(source_vert);
+            return program;
+        }
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
+    GLuint frag = video_shader_load(GL_FRAGMENT_SHADER, filename_frag, source_frag);
+    GLuint vert = video_shader_load(GL_VERTEX_SHADER, filename_vert, source_vert);
+    glAttachShader(program, frag);
+    glAttachShader(program, vert);
+    glLinkProgram(program);
+    glDetachShader(program, frag);
+    glDetachShader(program, vert);
+    glDeleteShader(frag);
+    glDeleteShader(vert);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+#ifdef DEBUG
+    if (!status) {
+        char buffer[1024];
+        glGetProgramInfoLog(program, sizeof(buffer), NULL, buffer);
+        printf("%s\n", buffer);
+    }
+#endif
+#ifndef __EMSCRIPTEN__
+    if (path && status) {
+        video_program_store(program, path);
+    }
+#endif
+    free(path);
+    free(source_frag);
+    free(source_vert);
+    return program;
+}
+
+static size_t video_env_stride(video_env_t *env) {
+    switch (env->clazz) {
+        case VIDEO_PRIMITIVE:
+            return 3;
+        case VIDEO_TEXTURED:
+            return 5;
+        case VIDEO_SPRITE_INSTANCED:
+            return 9;
+        default:
+            break;
+    }
+    return 4;
+}
+
+static void video_env_draw(video_t *self, video_env_t *env, GLenum mode, size_t offset, size_t first, size_t count) {
+    size_t stride = video_env_stride(env) * sizeof(float);
+    if (env->clazz == VIDEO_SPRITE_INSTANCED) {
+        glVertexAttribPointer(env->attrib_instance_dst, 4, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (offset + first * stride));
+        glVertexAttribPointer(env->attrib_instance_src, 4, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) (offset + first * stride + 4 * sizeof(float)));
+        glVertexAttribPointer(env->attrib_instance_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, (GLsizei) stride, (void*) (offset + first * stride + 8 * sizeof(float)));
+        glDrawArraysInstancedANGLE(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) count);
+        return;
+    }
+    glDrawArrays(mode, (GLint) (offset / stride + first), (GLsizei) count);
+}
+
+static void video_env_source(video_t *self, video_env_t *env, GLuint vbo) {
+    GLsizei stride = (GLsizei) (video_env_stride(env) * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    if (env->clazz == VIDEO_SPRITE_INSTANCED) {
+        return;
+    }
+    glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, stride, NULL);
+    glVertexAttribPointer(env->attrib_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*) (stride - sizeof(float)));
+    if (env->clazz == VIDEO_TEXTURED) {
+        glVertexAttribPointer(env->attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, stride, (void*) (2 * sizeof(float)));
+    }
+}
+
 static void video_env_init(video_t *self, video_clazz clazz, video_env_t *env) {
     env->clazz = clazz;
-    env->program = glCreateProgram();
+    const char *filename_frag = NULL;
+    const char *filename_vert = NULL;
     switch (env->clazz) {
         case VIDEO_PRIMITIVE:
-            glAttachShader(env->program, video_shader_load(GL_FRAGMENT_SHADER, "asset/shader/primitive.frag"));
-            glAttachShader(env->program, video_shader_load(GL_VERTEX_SHADER, "asset/shader/primitive.vert"));
+            filename_frag = "asset/shader/primitive.frag";
+            filename_vert = "asset/shader/primitive.vert";
             break;
         case VIDEO_TEXTURED:
-            glAttachShader(env->program, video_shader_load(GL_FRAGMENT_SHADER, "asset/shader/textured.frag"));
-            glAttachShader(env->program, video_shader_load(GL_VERTEX_SHADER, "asset/shader/textured.vert"));
+            filename_frag = "asset/shader/textured.frag";
+            filename_vert = "asset/shader/textured.vert";
             break;
         case VIDEO_PARTICLE:
-            glAttachShader(env->program, video_shader_load(GL_FRAGMENT_SHADER, "asset/shader/particle.frag"));
-            glAttachShader(env->program, video_shader_load(GL_VERTEX_SHADER, "asset/shader/particle.vert"));
+            filename_frag = "asset/shader/particle.frag";
+            filename_vert = "asset/shader/particle.vert";
             break;
         case VIDEO_PARTICLE_TEXTURED:
-            glAttachShader(env->program, video_shader_load(GL_FRAGMENT_SHADER, "asset/shader/particle_textured.frag"));
-            glAttachShader(env->program, video_shader_load(GL_VERTEX_SHADER, "asset/shader/particle_textured.vert"));
+            filename_frag = "asset/shader/particle_textured.frag";
+            filename_vert = "asset/shader/particle_textured.vert";
+            break;
+        case VIDEO_PARTICLE_GPU:
+            filename_frag = "asset/shader/particle.frag";
+            filename_vert = "asset/shader/particle_gpu.vert";
+            break;
+        case VIDEO_PARTICLE_GPU_TEXTURED:
+            filename_frag = "asset/shader/particle_textured.frag";
+            filename_vert = "asset/shader/particle_gpu_textured.vert";
+            break;
+        case VIDEO_SPRITE_INSTANCED:
+            filename_frag = "asset/shader/textured.frag";
+            filename_vert = "asset/shader/sprite_instanced.vert";
             break;
     }
-    glLinkProgram(env->program);
-#ifdef DEBUG
-    GLint status;
-    glGetProgramiv(env->program, GL_LINK_STATUS, &status);
-    if (!status) {
-        char buffer[1024];
-        glGetProgramInfoLog(env->program, sizeof(buffer), NULL, buffer);
-        printf("%s\n", buffer);
-    }
-#endif
+    env->program = video_program_load(self, filename_frag, filename_vert);
     env->attrib_position = (GLuint) glGetAttribLocation(env->program, "position");
     env->attrib_tex_coord = (GLuint) glGetAttribLocation(env->program, "texCoord");
+    env->attrib_color = (GLuint) glGetAttribLocation(env->program, "vertexColor");
     env->attrib_instance_offset = (GLuint) glGetAttribLocation(env->program, "instanceOffset");
     env->attrib_instance_color = (GLuint) glGetAttribLocation(env->program, "instanceColor");
+    env->attrib_instance_velocity = (GLuint) glGetAttribLocation(env->program, "instanceVelocity");
+    env->attrib_instance_time = (GLuint) glGetAttribLocation(env->program, "instanceTime");
+    env->attrib_instance_dst = (GLuint) glGetAttribLocation(env->program, "instanceDst");
+    env->attrib_instance_src = (GLuint) glGetAttribLocation(env->program, "instanceSrc");
     env->uniform_projection = (GLuint) glGetUniformLocation(env->program, "projection");
     env->uniform_color = (GLuint) glGetUniformLocation(env->program, "color");
+    env->uniform_time = (GLuint) glGetUniformLocation(env->program, "time");
     glGenVertexArraysOES(1, &env->vao);
     glBindVertexArrayOES(env->vao);
     glBindBuffer(GL_ARRAY_BUFFER, self->vbo[0]);
     switch (env->clazz) {
         case VIDEO_PRIMITIVE:
-            glEnableVertexAttribArray(env->attrib_position);
-            glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), NULL);
-            break;
         case VIDEO_TEXTURED:
             glEnableVertexAttribArray(env->attrib_position);
-            glEnableVertexAttribArray(env->attrib_tex_coord);
-            glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), NULL);
-            glVertexAttribPointer(env->attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*) (2 * sizeof(float)));
+            glEnableVertexAttribArray(env->attrib_color);
+            if (env->clazz == VIDEO_TEXTURED) {
+                glEnableVertexAttribArray(env->attrib_tex_coord);
+            }
+            video_env_source(self, env, self->vbo[0]);
             break;
         case VIDEO_PARTICLE:
             glEnableVertexAttribArray(env->attrib_position);
@@ -97,20 +250,79 @@ static void video_env_init(video_t *self, video_clazz clazz, video_env_t *env) {
             glVertexAttribPointer(env->attrib_instance_color, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*) (2 * sizeof(float)));
             glVertexAttribDivisorANGLE(env->attrib_instance_color, 1);
             break;
+        case VIDEO_PARTICLE_GPU:
+            glEnableVertexAttribArray(env->attrib_position);
+            glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), NULL);
+            glEnableVertexAttribArray(env->attrib_instance_offset);
+            glVertexAttribDivisorANGLE(env->attrib_instance_offset, 1);
+            glEnableVertexAttribArray(env->attrib_instance_velocity);
+            glVertexAttribDivisorANGLE(env->attrib_instance_velocity, 1);
+            glEnableVertexAttribArray(env->attrib_instance_color);
+            glVertexAttribDivisorANGLE(env->attrib_instance_color, 1);
+            glEnableVertexAttribArray(env->attrib_instance_time);
+            glVertexAttribDivisorANGLE(env->attrib_instance_time, 1);
+            break;
+        case VIDEO_PARTICLE_GPU_TEXTURED:
+            glEnableVertexAttribArray(env->attrib_position);
+            glEnableVertexAttribArray(env->attrib_tex_coord);
+            glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), NULL);
+            glVertexAttribPointer(env->attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*) (2 * sizeof(float)));
+            glEnableVertexAttribArray(env->attrib_instance_offset);
+            glVertexAttribDivisorANGLE(env->attrib_instance_offset, 1);
+            glEnableVertexAttribArray(env->attrib_instance_velocity);
+            glVertexAttribDivisorANGLE(env->attrib_instance_velocity, 1);
+            glEnableVertexAttribArray(env->attrib_instance_color);
+            glVertexAttribDivisorANGLE(env->attrib_instance_color, 1);
+            glEnableVertexAttribArray(env->attrib_instance_time);
+            glVertexAttribDivisorANGLE(env->attrib_instance_time, 1);
+            break;
+        case VIDEO_SPRITE_INSTANCED:
+            glBindBuffer(GL_ARRAY_BUFFER, self->vbo_quad);
+            glEnableVertexAttribArray(env->attrib_position);
+            glVertexAttribPointer(env->attrib_position, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), NULL);
+            glBindBuffer(GL_ARRAY_BUFFER, self->vbo[0]);
+            glEnableVertexAttribArray(env->attrib_instance_dst);
+            glVertexAttribDivisorANGLE(env->attrib_instance_dst, 1);
+            glEnableVertexAttribArray(env->attrib_instance_src);
+            glVertexAttribDivisorANGLE(env->attrib_instance_src, 1);
+            glEnableVertexAttribArray(env->attrib_instance_color);
+            glVertexAttribDivisorANGLE(env->attrib_instance_color, 1);
+            break;
     }
 }
 
-GLenum video_env_set(video_t *self, video_env_t *env) {
+void video_env_use(video_t *self, video_env_t *env, vec4_t color) {
     if (self->env != env) {
         glUseProgram(env->program);
         glBindVertexArrayOES(env->vao);
         self->env = env;
+        self->stats_frame.env_switches++;
     }
-    video_cfg_t *cfg = array_get_last(self->configs);
     if (env->dirty) {
+        video_cfg_t *cfg = array_get_last(self->configs);
         glUniformMatrix4fv(env->uniform_projection, 1, GL_FALSE, mat4_transpose(cfg->projection).ptr);
-        glUniform4fv(env->uniform_color, 1, cfg->color.ptr);
+        glUniform4fv(env->uniform_color, 1, color.ptr);
+        env->color = color;
         env->dirty = false;
+        self->stats_frame.uniforms += 2;
+    } else if (memcmp(&env->color, &color, sizeof(color))) {
+        glUniform4fv(env->uniform_color, 1, color.ptr);
+        env->color = color;
+        self->stats_frame.uniforms++;
+    }
+}
+
+void video_env_instances(video_t *self, video_env_t *env, size_t position, size_t color, size_t stride) {
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo[1]);
+    glVertexAttribPointer(env->attrib_instance_offset, 2, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) position);
+    glVertexAttribPointer(env->attrib_instance_color, 4, GL_FLOAT, GL_FALSE, (GLsizei) stride, (void*) color);
+}
+
+GLenum video_env_set(video_t *self, video_env_t *env) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    self->batch_env = env;
+    if (!self->deferred) {
+        video_env_use(self, env, cfg->tint);
     }
     switch (cfg->mode) {
         case VIDEO_DOT:
@@ -132,6 +344,12 @@ void video_data_clear(video_t *self) {
     self->buffer_size = 0;
 }
 
+void video_data_reserve(video_t *self, size_t count) {
+    if (self->buffer_size + count > VIDEO_BUFFER_SIZE && self->batch_flush) {
+        self->batch_flush(self);
+    }
+}
+
 void video_data_put2(video_t *self, float p0, float p1) {
     size_t i = self->buffer_size;
     self->buffer[i] = p0;
@@ -148,9 +366,575 @@ void video_data_put4(video_t *self, float p0, float p1, float p2, float p3) {
     self->buffer_size += 4;
 }
 
-void video_data_send(video_t *self, int vbo_index) {
+void video_data_put_color(video_t *self, uint32_t color) {
+    memcpy(self->buffer + self->buffer_size, &color, sizeof(color));
+    self->buffer_size++;
+}
+
+bool video_transform_identity(video_transform_t transform) {
+    return transform.a == 1 && transform.b == 0 && transform.c == 0 && transform.d == 1 && transform.e == 0 && transform.f == 0;
+}
+
+bool video_transform_aligned(video_transform_t transform) {
+    return transform.b == 0 && transform.c == 0;
+}
+
+static void video_transform_points(video_transform_t t, float *data, size_t stride, size_t count) {
+    size_t i = 0;
+#if defined(__SSE__)
+    __m128 ab = _mm_setr_ps(t.a, t.b, t.a, t.b);
+    __m128 cd = _mm_setr_ps(t.c, t.d, t.c, t.d);
+    __m128 ef = _mm_setr_ps(t.e, t.f, t.e, t.f);
+    for (; i + 2 <= count; i += 2) {
+        float *p0 = data + i * stride;
+        float *p1 = p0 + stride;
+        __m128 p = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (__m64*) p0), (__m64*) p1);
+        __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+        p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ab, x), _mm_mul_ps(cd, y)), ef);
+        _mm_storel_pi((__m64*) p0, p);
+        _mm_storeh_pi((__m64*) p1, p);
+    }
+#endif
+    for (; i < count; i++) {
+        float *p = data + i * stride;
+        float x = p[0];
+        p[0] = t.a * x + t.c * p[1] + t.e;
+        p[1] = t.b * x + t.d * p[1] + t.f;
+    }
+}
+
+static void video_transform_rects(video_transform_t t, float *data, size_t stride, size_t count) {
+    size_t i = 0;
+#if defined(__SSE__)
+    __m128 scale = _mm_setr_ps(t.a, t.d, t.a, t.d);
+    __m128 offset = _mm_setr_ps(t.e, t.f, 0, 0);
+    for (; i < count; i++) {
+        float *p = data + i * stride;
+        _mm_storeu_ps(p, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p), scale), offset));
+    }
+#endif
+    for (; i < count; i++) {
+        float *p = data + i * stride;
+        p[0] = t.a * p[0] + t.e;
+        p[1] = t.d * p[1] + t.f;
+        p[2] *= t.a;
+        p[3] *= t.d;
+    }
+}
+
+static void video_data_transform(video_t *self, size_t count) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    if (video_transform_identity(cfg->transform)) {
+        return;
+    }
+    size_t stride = video_env_stride(self->batch_env);
+    if (self->batch_env->clazz == VIDEO_SPRITE_INSTANCED) {
+        video_transform_rects(cfg->transform, self->buffer, stride, count);
+    } else {
+        video_transform_points(cfg->transform, self->buffer, stride, count);
+    }
+}
+
+uint32_t video_color_pack(vec4_t color) {
+    uint8_t rgba[4];
+    for (int i = 0; i < 4; i++) {
+        rgba[i] = (uint8_t) (MIN(MAX(color.ptr[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+    uint32_t packed;
+    memcpy(&packed, rgba, sizeof(packed));
+    return packed;
+}
+
+static void video_stream_init(video_t *self, int vbo_index) {
+    video_stream_t *stream = &self->streams[vbo_index];
+    stream->offset = 0;
+    stream->region = 0;
     glBindBuffer(GL_ARRAY_BUFFER, self->vbo[vbo_index]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, self->buffer_size * sizeof(float), self->buffer);
+#ifndef __EMSCRIPTEN__
+    for (int i = 0; i < VIDEO_STREAM_REGIONS; i++) {
+        stream->fences[i] = NULL;
+    }
+    if (self->stream_sync) {
+        glBufferData(GL_ARRAY_BUFFER, VIDEO_STREAM_REGIONS * VIDEO_STREAM_SIZE, NULL, GL_STREAM_DRAW);
+        return;
+    }
+#endif
+    glBufferData(GL_ARRAY_BUFFER, VIDEO_STREAM_SIZE, NULL, GL_STREAM_DRAW);
+}
+
+static size_t video_stream_next(video_t *self, video_stream_t *stream) {
+#ifndef __EMSCRIPTEN__
+    if (self->stream_sync) {
+        stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream->region = (stream->region + 1) % VIDEO_STREAM_REGIONS;
+        GLsync fence = stream->fences[stream->region];
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                self->stats_frame.stalls++;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(fence);
+            stream->fences[stream->region] = NULL;
+        }
+        return stream->region * VIDEO_STREAM_SIZE;
+    }
+#endif
+    glBufferData(GL_ARRAY_BUFFER, VIDEO_STREAM_SIZE, NULL, GL_STREAM_DRAW);
+    return 0;
+}
+
+static void video_stream_shutdown(video_stream_t *stream) {
+#ifndef __EMSCRIPTEN__
+    for (int i = 0; i < VIDEO_STREAM_REGIONS; i++) {
+        if (stream->fences[i]) {
+            glDeleteSync(stream->fences[i]);
+        }
+    }
+#endif
+}
+
+size_t video_data_send(video_t *self, int vbo_index, size_t align) {
+    return video_data_write(self, vbo_index, self->buffer, self->buffer_size * sizeof(float), align);
+}
+
+size_t video_data_write(video_t *self, int vbo_index, const void *data, size_t size, size_t align) {
+    video_stream_t *stream = &self->streams[vbo_index];
+    size_t offset = (stream->offset + align - 1) / align * align;
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo[vbo_index]);
+    if (offset + size > (stream->region + 1) * VIDEO_STREAM_SIZE) {
+        offset = (video_stream_next(self, stream) + align - 1) / align * align;
+    }
+#ifndef __EMSCRIPTEN__
+    if (self->stream_sync) {
+        void *ptr = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    }
+#else
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+#endif
+    stream->offset = offset + size;
+    self->stats_frame.uploads++;
+    self->stats_frame.bytes += size;
+    return offset;
+}
+
+static void video_queue_init(video_queue_t *queue) {
+    queue->commands = array_new(sizeof(video_cmd_t));
+    queue->batches = array_new(sizeof(video_batch_t));
+    queue->data_size = 0;
+    queue->data_capacity = VIDEO_BUFFER_SIZE;
+    queue->data = malloc_ext(queue->data_capacity * sizeof(float));
+}
+
+static void video_queue_clear(video_queue_t *queue) {
+    queue->commands->size = 0;
+    queue->batches->size = 0;
+    queue->data_size = 0;
+}
+
+static float *video_queue_reserve(video_queue_t *queue, size_t count) {
+    if (queue->data_size + count > queue->data_capacity) {
+        while (queue->data_size + count > queue->data_capacity) {
+            queue->data_capacity *= 2;
+        }
+        queue->data = realloc_ext(queue->data, queue->data_capacity * sizeof(float));
+    }
+    float *ptr = queue->data + queue->data_size;
+    queue->data_size += count;
+    return ptr;
+}
+
+static void video_queue_record(video_queue_t *queue, video_t *self, GLenum mode, size_t count) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    video_env_t *env = self->batch_env;
+    size_t stride = video_env_stride(env);
+    video_cmd_t *cmd = array_add_last(queue->commands, NULL);
+    cmd->env = env;
+    cmd->texture = env->clazz == VIDEO_PRIMITIVE ? 0 : self->batch_texture;
+    cmd->vbo = 0;
+    cmd->color = cfg->tint;
+    cmd->first = queue->data_size;
+    cmd->offset = 0;
+    cmd->next = -1;
+    cmd->bounds = vec4_new(INFINITY, INFINITY, -INFINITY, -INFINITY);
+    for (size_t i = 0; i < count; i++) {
+        float *vertex = self->buffer + i * stride;
+        float w = env->clazz == VIDEO_SPRITE_INSTANCED ? vertex[2] : 0;
+        float h = env->clazz == VIDEO_SPRITE_INSTANCED ? vertex[3] : 0;
+        cmd->bounds.x = MIN(cmd->bounds.x, MIN(vertex[0], vertex[0] + w) - 1);
+        cmd->bounds.y = MIN(cmd->bounds.y, MIN(vertex[1], vertex[1] + h) - 1);
+        cmd->bounds.z = MAX(cmd->bounds.z, MAX(vertex[0], vertex[0] + w) + 1);
+        cmd->bounds.w = MAX(cmd->bounds.w, MAX(vertex[1], vertex[1] + h) + 1);
+    }
+    switch (mode) {
+        case GL_TRIANGLE_FAN:
+            cmd->mode = GL_TRIANGLES;
+            cmd->count = count >= 3 ? 3 * (count - 2) : 0;
+            for (size_t i = 1; i + 1 < count; i++) {
+                memcpy(video_queue_reserve(queue, stride), self->buffer, stride * sizeof(float));
+                memcpy(video_queue_reserve(queue, 2 * stride), self->buffer + i * stride, 2 * stride * sizeof(float));
+            }
+            break;
+        case GL_LINE_LOOP:
+            cmd->mode = GL_LINES;
+            cmd->count = 2 * count;
+            for (size_t i = 0; i < count; i++) {
+                memcpy(video_queue_reserve(queue, stride), self->buffer + i * stride, stride * sizeof(float));
+                memcpy(video_queue_reserve(queue, stride), self->buffer + ((i + 1) % count) * stride, stride * sizeof(float));
+            }
+            break;
+        default:
+            cmd->mode = mode;
+            cmd->count = count;
+            memcpy(video_queue_reserve(queue, count * stride), self->buffer, count * stride * sizeof(float));
+            break;
+    }
+}
+
+static void video_queue_record_retained(video_queue_t *queue, video_part_t *part, GLuint vbo, size_t first, size_t count, vec4_t bounds) {
+    video_cmd_t *cmd = array_add_last(queue->commands, NULL);
+    cmd->env = part->env;
+    cmd->texture = part->texture;
+    cmd->vbo = vbo;
+    cmd->color = part->color;
+    cmd->mode = part->mode;
+    cmd->bounds = bounds;
+    cmd->first = first;
+    cmd->count = count;
+    cmd->offset = 0;
+    cmd->next = -1;
+}
+
+static bool video_bounds_overlap(vec4_t a, vec4_t b) {
+    return a.x < b.z && b.x < a.z && a.y < b.w && b.y < a.w;
+}
+
+static bool video_batch_accepts(video_batch_t *batch, video_cmd_t *cmd) {
+    return batch->env == cmd->env && batch->texture == cmd->texture && batch->vbo == cmd->vbo && batch->mode == cmd->mode && !memcmp(&batch->color, &cmd->color, sizeof(vec4_t));
+}
+
+static void video_queue_merge(video_queue_t *queue) {
+    queue->batches->size = 0;
+    for (int i = 0; i < queue->commands->size; i++) {
+        video_cmd_t *cmd = array_get(queue->commands, i);
+        video_batch_t *target = NULL;
+        int size = (int) queue->batches->size;
+        for (int j = size - 1; j >= 0 && j >= size - VIDEO_QUEUE_LOOKBACK; j--) {
+            video_batch_t *batch = array_get(queue->batches, j);
+            if (video_batch_accepts(batch, cmd)) {
+                target = batch;
+                break;
+            }
+            if (video_bounds_overlap(batch->bounds, cmd->bounds)) {
+                break;
+            }
+        }
+        if (target) {
+            video_cmd_t *tail = array_get(queue->commands, target->tail);
+            tail->next = i;
+            target->tail = i;
+            target->bounds.x = MIN(target->bounds.x, cmd->bounds.x);
+            target->bounds.y = MIN(target->bounds.y, cmd->bounds.y);
+            target->bounds.z = MAX(target->bounds.z, cmd->bounds.z);
+            target->bounds.w = MAX(target->bounds.w, cmd->bounds.w);
+        } else {
+            target = array_add_last(queue->batches, NULL);
+            target->env = cmd->env;
+            target->texture = cmd->texture;
+            target->vbo = cmd->vbo;
+            target->color = cmd->color;
+            target->mode = cmd->mode;
+            target->bounds = cmd->bounds;
+            target->head = i;
+            target->tail = i;
+        }
+    }
+}
+
+static void video_queue_draw(video_t *self) {
+    if (!self->draws->size) {
+        return;
+    }
+    size_t offset = self->buffer_size ? video_data_send(self, 0, VIDEO_DATA_ALIGN) : 0;
+    GLuint texture = 0;
+    iterator_t iterator = array_iterator(self->draws);
+    while (iterator_has_next(iterator)) {
+        video_draw_t *draw = iterator_next(iterator);
+        video_batch_t *batch = draw->batch;
+        video_env_use(self, batch->env, batch->color);
+        if (batch->texture && batch->texture != texture) {
+            glBindTexture(GL_TEXTURE_2D, batch->texture);
+            texture = batch->texture;
+            self->stats_frame.binds++;
+        }
+        if (batch->vbo) {
+            video_env_source(self, batch->env, batch->vbo);
+            video_env_draw(self, batch->env, batch->mode, 0, draw->first, draw->count);
+            video_env_source(self, batch->env, self->vbo[0]);
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, self->vbo[0]);
+            video_env_draw(self, batch->env, batch->mode, offset, draw->first, draw->count);
+        }
+        self->stats_frame.draws++;
+    }
+    self->draws->size = 0;
+    video_data_clear(self);
+}
+
+static void video_queue_submit(video_t *self, video_queue_t *queue) {
+    video_queue_merge(queue);
+    video_data_clear(self);
+    iterator_t iterator = array_iterator(queue->batches);
+    while (iterator_has_next(iterator)) {
+        video_batch_t *batch = iterator_next(iterator);
+        size_t stride = video_env_stride(batch->env);
+        video_draw_t *draw = NULL;
+        if (batch->vbo) {
+            for (int i = batch->head; i >= 0;) {
+                video_cmd_t *cmd = array_get(queue->commands, i);
+                draw = array_add_last(self->draws, NULL);
+                draw->batch = batch;
+                draw->first = cmd->first;
+                draw->count = cmd->count;
+                i = cmd->next;
+            }
+            continue;
+        }
+        for (int i = batch->head; i >= 0;) {
+            video_cmd_t *cmd = array_get(queue->commands, i);
+            size_t size = cmd->count * stride;
+            size_t offset = (self->buffer_size + stride - 1) / stride * stride;
+            if (offset + size > VIDEO_BUFFER_SIZE) {
+                video_queue_draw(self);
+                draw = NULL;
+                offset = 0;
+            }
+            if (!draw) {
+                draw = array_add_last(self->draws, NULL);
+                draw->batch = batch;
+                draw->first = offset / stride;
+                draw->count = 0;
+            }
+            memcpy(self->buffer + offset, queue->data + cmd->first, size * sizeof(float));
+            self->buffer_size = offset + size;
+            draw->count += cmd->count;
+            i = cmd->next;
+        }
+    }
+    video_queue_draw(self);
+    video_queue_clear(queue);
+}
+
+static void video_queue_limit(video_t *self) {
+    video_queue_t *queue = &self->queue;
+    size_t memory = queue->data_capacity * sizeof(float) + queue->commands->capacity * sizeof(video_cmd_t) + queue->batches->capacity * sizeof(video_batch_t);
+    self->stats_frame.memory = MAX(self->stats_frame.memory, memory);
+    if (queue->data_size >= VIDEO_QUEUE_DATA || queue->commands->size >= VIDEO_QUEUE_COMMANDS) {
+        video_queue_submit(self, queue);
+    }
+}
+
+static void video_queue_shutdown(video_queue_t *queue) {
+    array_delete(queue->commands);
+    array_delete(queue->batches);
+    free(queue->data);
+}
+
+void video_data_draw(video_t *self, GLenum mode, size_t count) {
+    video_data_transform(self, count);
+    if (self->mesh) {
+        video_queue_record(&self->mesh->queue, self, mode, count);
+        return;
+    }
+    self->stats_frame.commands++;
+    if (self->deferred) {
+        video_queue_record(&self->queue, self, mode, count);
+        video_queue_limit(self);
+        return;
+    }
+    size_t stride = video_env_stride(self->batch_env) * sizeof(float);
+    size_t offset = video_data_send(self, 0, stride);
+    video_env_draw(self, self->batch_env, mode, offset, 0, count);
+    self->stats_frame.draws++;
+}
+
+static void video_part_draw(video_t *self, video_part_t *part, GLuint vbo, size_t first, size_t count, vec4_t bounds) {
+    self->stats_frame.commands++;
+    if (self->deferred) {
+        video_queue_record_retained(&self->queue, part, vbo, first, count, bounds);
+        video_queue_limit(self);
+        return;
+    }
+    video_env_use(self, part->env, part->color);
+    if (part->texture) {
+        glBindTexture(GL_TEXTURE_2D, part->texture);
+        self->stats_frame.binds++;
+    }
+    video_env_source(self, part->env, vbo);
+    video_env_draw(self, part->env, part->mode, 0, first, count);
+    video_env_source(self, part->env, self->vbo[0]);
+    self->stats_frame.draws++;
+}
+
+void video_data_retained(video_t *self, GLenum mode, GLuint vbo, size_t first, size_t count, vec4_t bounds) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    video_part_t part = {
+            .env = self->batch_env,
+            .texture = self->batch_env->clazz == VIDEO_PRIMITIVE ? 0 : self->batch_texture,
+            .color = cfg->tint,
+            .mode = mode
+    };
+    video_part_draw(self, &part, vbo, first, count, bounds);
+}
+
+static void video_mesh_build(video_mesh_t *mesh) {
+    video_queue_t *queue = &mesh->queue;
+    iterator_t iterator = array_iterator(queue->commands);
+    while (iterator_has_next(iterator)) {
+        video_cmd_t *cmd = iterator_next(iterator);
+        cmd->next = -1;
+    }
+    video_queue_merge(queue);
+    mesh->parts->size = 0;
+    size_t size = 0;
+    float *data = malloc_ext((queue->data_size + VIDEO_STRIDE_MAX * queue->batches->size) * sizeof(float));
+    iterator = array_iterator(queue->batches);
+    while (iterator_has_next(iterator)) {
+        video_batch_t *batch = iterator_next(iterator);
+        size_t stride = video_env_stride(batch->env);
+        size = (size + stride - 1) / stride * stride;
+        video_part_t *part = array_add_last(mesh->parts, NULL);
+        part->env = batch->env;
+        part->texture = batch->texture;
+        part->color = batch->color;
+        part->mode = batch->mode;
+        part->bounds = batch->bounds;
+        part->first = size / stride;
+        part->count = 0;
+        for (int i = batch->head; i >= 0;) {
+            video_cmd_t *cmd = array_get(queue->commands, i);
+            cmd->offset = size;
+            memcpy(data + size, queue->data + cmd->first, cmd->count * stride * sizeof(float));
+            size += cmd->count * stride;
+            part->count += cmd->count;
+            i = cmd->next;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    glBufferData(GL_ARRAY_BUFFER, size * sizeof(float), data, GL_STATIC_DRAW);
+    free(data);
+}
+
+video_mesh_t *video_mesh_begin(video_t *self) {
+    video_mesh_t *mesh = malloc_ext(sizeof(*mesh));
+    video_queue_init(&mesh->queue);
+    mesh->parts = array_new(sizeof(video_part_t));
+    glGenBuffers(1, &mesh->vbo);
+    self->mesh = mesh;
+    return mesh;
+}
+
+void video_mesh_end(video_t *self, video_mesh_t *mesh) {
+    self->mesh = NULL;
+    video_mesh_build(mesh);
+}
+
+size_t video_mesh_elements(video_mesh_t *mesh) {
+    return mesh->queue.commands->size;
+}
+
+void video_mesh_color(video_mesh_t *mesh, size_t element, vec4_t color) {
+    video_cmd_t *cmd = array_get(mesh->queue.commands, (int) element);
+    size_t stride = video_env_stride(cmd->env);
+    float *data = mesh->queue.data + cmd->first;
+    uint32_t packed = video_color_pack(color);
+    if (!cmd->count || !memcmp(data + stride - 1, &packed, sizeof(packed))) {
+        return;
+    }
+    for (size_t i = 0; i < cmd->count; i++) {
+        memcpy(data + i * stride + stride - 1, &packed, sizeof(packed));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, cmd->offset * sizeof(float), cmd->count * stride * sizeof(float), data);
+}
+
+static void video_mesh_expand(video_t *self, const float *data, size_t count) {
+    size_t chunk = VIDEO_BUFFER_SIZE / 30;
+    video_data_clear(self);
+    for (size_t first = 0; first < count; first += chunk) {
+        size_t quads = MIN(chunk, count - first);
+        for (size_t i = first; i < first + quads; i++) {
+            const float *p = data + i * 9;
+            uint32_t color;
+            memcpy(&color, p + 8, sizeof(color));
+            video_data_put4(self, p[0], p[1] + p[3], p[4], p[7]);
+            video_data_put_color(self, color);
+            video_data_put4(self, p[0], p[1], p[4], p[5]);
+            video_data_put_color(self, color);
+            video_data_put4(self, p[0] + p[2], p[1], p[6], p[5]);
+            video_data_put_color(self, color);
+            video_data_put4(self, p[0], p[1] + p[3], p[4], p[7]);
+            video_data_put_color(self, color);
+            video_data_put4(self, p[0] + p[2], p[1], p[6], p[5]);
+            video_data_put_color(self, color);
+            video_data_put4(self, p[0] + p[2], p[1] + p[3], p[6], p[7]);
+            video_data_put_color(self, color);
+        }
+        video_data_draw(self, GL_TRIANGLES, 6 * quads);
+        video_data_clear(self);
+    }
+}
+
+static void video_mesh_stream(video_t *self, video_mesh_t *mesh) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    bool aligned = video_transform_aligned(cfg->transform);
+    vec4_t tint = cfg->tint;
+    iterator_t iterator = array_iterator(mesh->queue.commands);
+    while (iterator_has_next(iterator)) {
+        video_cmd_t *cmd = iterator_next(iterator);
+        size_t size = cmd->count * video_env_stride(cmd->env);
+        bool expand = cmd->env == &self->env_sprite_instanced && !aligned;
+        cfg->tint = cmd->color;
+        video_env_set(self, expand ? &self->env_textured : cmd->env);
+        self->batch_texture = cmd->texture;
+        if (!self->deferred && cmd->texture) {
+            glBindTexture(GL_TEXTURE_2D, cmd->texture);
+            self->stats_frame.binds++;
+        }
+        if (expand) {
+            video_mesh_expand(self, mesh->queue.data + cmd->first, cmd->count);
+            continue;
+        }
+        memcpy(self->buffer, mesh->queue.data + cmd->first, size * sizeof(float));
+        self->buffer_size = size;
+        video_data_draw(self, cmd->mode, cmd->count);
+    }
+    cfg->tint = tint;
+    video_data_clear(self);
+}
+
+void video_mesh_draw(video_t *self, video_mesh_t *mesh) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    if (!video_transform_identity(cfg->transform)) {
+        video_mesh_stream(self, mesh);
+        return;
+    }
+    iterator_t iterator = array_iterator(mesh->parts);
+    while (iterator_has_next(iterator)) {
+        video_part_t *part = iterator_next(iterator);
+        video_part_draw(self, part, mesh->vbo, part->first, part->count, part->bounds);
+    }
+}
+
+void video_mesh_delete(video_mesh_t *mesh) {
+    glDeleteBuffers(1, &mesh->vbo);
+    video_queue_shutdown(&mesh->queue);
+    array_delete(mesh->parts);
+    free(mesh);
 }
 
 static void video_mark_dirty(video_t *self) {
@@ -158,34 +942,73 @@ static void video_mark_dirty(video_t *self) {
     self->env_textured.dirty = true;
     self->env_particles.dirty = true;
     self->env_particles_textured.dirty = true;
+    self->env_particles_gpu.dirty = true;
+    self->env_particles_gpu_textured.dirty = true;
+    self->env_sprite_instanced.dirty = true;
 }
 
 video_t *video_new() {
     video_t *self = malloc_ext(sizeof(*self));
     self->buffer = malloc_ext(VIDEO_BUFFER_SIZE * sizeof(float));
+#ifdef __EMSCRIPTEN__
+    self->stream_sync = false;
+#else
+    self->stream_sync = epoxy_is_desktop_gl() && epoxy_gl_version() >= 32;
+#endif
     glGenBuffers(ARRAY_LENGTH(self->vbo), self->vbo);
     for (int i = 0; i < ARRAY_LENGTH(self->vbo); i++) {
-        glBindBuffer(GL_ARRAY_BUFFER, self->vbo[i]);
-        glBufferData(GL_ARRAY_BUFFER, VIDEO_BUFFER_SIZE * sizeof(float), NULL, GL_STREAM_DRAW);
+        video_stream_init(self, i);
     }
+    float quad[] = {0, 1, 0, 0, 1, 1, 1, 0};
+    glGenBuffers(1, &self->vbo_quad);
+    glBindBuffer(GL_ARRAY_BUFFER, self->vbo_quad);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, self->vbo[0]);
+    self->shader_cache = NULL;
+    self->shader_hash = VIDEO_HASH_OFFSET;
+#ifndef __EMSCRIPTEN__
+    GLint formats = 0;
+    if (epoxy_is_desktop_gl() && (epoxy_gl_version() >= 41 || epoxy_has_gl_extension("GL_ARB_get_program_binary"))) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    if (formats > 0) {
+        self->shader_cache = SDL_GetPrefPath("UsbClicker", "shader");
+        self->shader_hash = video_hash(self->shader_hash, (const char*) glGetString(GL_VENDOR));
+        self->shader_hash = video_hash(self->shader_hash, (const char*) glGetString(GL_RENDERER));
+        self->shader_hash = video_hash(self->shader_hash, (const char*) glGetString(GL_VERSION));
+    }
+#endif
     video_env_init(self, VIDEO_PRIMITIVE, &self->env_primitive);
     video_env_init(self, VIDEO_TEXTURED, &self->env_textured);
     video_env_init(self, VIDEO_PARTICLE, &self->env_particles);
     video_env_init(self, VIDEO_PARTICLE_TEXTURED, &self->env_particles_textured);
+    video_env_init(self, VIDEO_PARTICLE_GPU, &self->env_particles_gpu);
+    video_env_init(self, VIDEO_PARTICLE_GPU_TEXTURED, &self->env_particles_gpu_textured);
+    video_env_init(self, VIDEO_SPRITE_INSTANCED, &self->env_sprite_instanced);
     self->env = NULL;
+    self->batch_env = NULL;
+    self->batch_texture = 0;
+    self->batch_flush = NULL;
+    self->deferred = false;
+    self->instanced = false;
+    video_queue_init(&self->queue);
+    self->draws = array_new(sizeof(video_draw_t));
+    self->mesh = NULL;
+    self->stats = (video_stats_t) {};
+    self->stats_frame = (video_stats_t) {};
     vec2_t viewport = ctx_viewport();
     self->configs = array_new(sizeof(video_cfg_t));
     video_cfg_t *cfg = array_add_last(self->configs, NULL);
     cfg->mode = VIDEO_FILL;
     cfg->projection = mat4_ortho(0, viewport.x, viewport.y, 0, -1, 127);
     cfg->color = COLOR_RGBA(255, 255, 255, 255);
-    glFrontFace(GL_CW);
+    cfg->tint = COLOR_RGBA(255, 255, 255, 255);
+    cfg->packed = video_color_pack(cfg->color);
+    cfg->transform = (video_transform_t) {1, 0, 0, 1, 0, 0};
     glViewport(0, 0, (GLsizei) viewport.x, (GLsizei) viewport.y);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
     video_mark_dirty(self);
     return self;
 }
@@ -193,7 +1016,12 @@ video_t *video_new() {
 void video_cfg_color(video_t *self, vec4_t color) {
     video_cfg_t *cfg = array_get_last(self->configs);
     cfg->color = color;
-    video_mark_dirty(self);
+    cfg->packed = video_color_pack(color);
+}
+
+void video_cfg_tint(video_t *self, vec4_t tint) {
+    video_cfg_t *cfg = array_get_last(self->configs);
+    cfg->tint = tint;
 }
 
 void video_cfg_mode(video_t *self, video_mode mode) {
@@ -201,38 +1029,133 @@ void video_cfg_mode(video_t *self, video_mode mode) {
     cfg->mode = mode;
 }
 
+void video_cfg_deferred(video_t *self, bool deferred) {
+    if (self->deferred && !deferred) {
+        video_flush(self);
+    }
+    self->deferred = deferred;
+}
+
+void video_cfg_instanced(video_t *self, bool instanced) {
+    self->instanced = instanced;
+}
+
+static void video_transform_set(video_t *self, video_transform_t transform) {
+    if (self->batch_flush) {
+        self->batch_flush(self);
+    }
+    video_cfg_t *cfg = array_get_last(self->configs);
+    cfg->transform = transform;
+    if (self->batch_flush && self->batch_env == &self->env_sprite_instanced && !video_transform_aligned(transform)) {
+        video_env_set(self, &self->env_textured);
+    }
+}
+
+void video_push(video_t *self) {
+    video_cfg_t cfg = *(video_cfg_t*) array_get_last(self->configs);
+    array_add_last(self->configs, &cfg);
+}
+
+void video_pop(video_t *self) {
+    if (self->configs->size < 2) {
+        return;
+    }
+    video_cfg_t *cfg = array_get(self->configs, (int) self->configs->size - 2);
+    video_transform_set(self, cfg->transform);
+    self->configs->size--;
+}
+
+void video_translate(video_t *self, float x, float y) {
+    video_transform_t t = ((video_cfg_t*) array_get_last(self->configs))->transform;
+    t.e += t.a * x + t.c * y;
+    t.f += t.b * x + t.d * y;
+    video_transform_set(self, t);
+}
+
+void video_scale(video_t *self, float x, float y) {
+    video_transform_t t = ((video_cfg_t*) array_get_last(self->configs))->transform;
+    t.a *= x;
+    t.b *= x;
+    t.c *= y;
+    t.d *= y;
+    video_transform_set(self, t);
+}
+
+void video_rotate(video_t *self, float angle) {
+    video_transform_t t = ((video_cfg_t*) array_get_last(self->configs))->transform;
+    float cos_a = cosf(angle);
+    float sin_a = sinf(angle);
+    video_transform_set(self, (video_transform_t) {
+            t.a * cos_a + t.c * sin_a,
+            t.b * cos_a + t.d * sin_a,
+            t.c * cos_a - t.a * sin_a,
+            t.d * cos_a - t.b * sin_a,
+            t.e,
+            t.f
+    });
+}
+
 void video_clear(video_t *self) {
+    self->stats = self->stats_frame;
+    self->stats_frame = (video_stats_t) {};
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void video_rectangle(video_t *self, float x, float y, float w, float h) {
+    video_cfg_t *cfg = array_get_last(self->configs);
     GLenum mode = video_env_set(self, &self->env_primitive);
     video_data_clear(self);
     video_data_put2(self, x, y);
+    video_data_put_color(self, cfg->packed);
     video_data_put2(self, x + w, y);
+    video_data_put_color(self, cfg->packed);
     video_data_put2(self, x + w, y + h);
+    video_data_put_color(self, cfg->packed);
     video_data_put2(self, x, y + h);
-    video_data_send(self, 0);
-    glDrawArrays(mode, 0, 4);
+    video_data_put_color(self, cfg->packed);
+    video_data_draw(self, mode, 4);
 }
 
 void video_triangle(video_t *self, float x0, float y0, float x1, float y1, float x2, float y2) {
+    video_cfg_t *cfg = array_get_last(self->configs);
     GLenum mode = video_env_set(self, &self->env_primitive);
     video_data_clear(self);
     video_data_put2(self, x0, y0);
+    video_data_put_color(self, cfg->packed);
     video_data_put2(self, x1, y1);
+    video_data_put_color(self, cfg->packed);
     video_data_put2(self, x2, y2);
-    video_data_send(self, 0);
-    glDrawArrays(mode, 0, 3);
+    video_data_put_color(self, cfg->packed);
+    video_data_draw(self, mode, 3);
+}
+
+void video_flush(video_t *self) {
+    if (self->queue.commands->size) {
+        video_queue_submit(self, &self->queue);
+    }
+}
+
+video_stats_t video_stats(video_t *self) {
+    return self->stats;
 }
 
 void video_delete(video_t *self) {
+    video_queue_shutdown(&self->queue);
+    array_delete(self->draws);
     array_delete(self->configs);
     video_env_shutdown(&self->env_primitive);
     video_env_shutdown(&self->env_textured);
     video_env_shutdown(&self->env_particles);
     video_env_shutdown(&self->env_particles_textured);
+    video_env_shutdown(&self->env_particles_gpu);
+    video_env_shutdown(&self->env_particles_gpu_textured);
+    video_env_shutdown(&self->env_sprite_instanced);
+    for (int i = 0; i < ARRAY_LENGTH(self->streams); i++) {
+        video_stream_shutdown(&self->streams[i]);
+    }
     glDeleteBuffers(ARRAY_LENGTH(self->vbo), self->vbo);
+    glDeleteBuffers(1, &self->vbo_quad);
+    SDL_free(self->shader_cache);
     free(self->buffer);
     free(self);
 }
\ No newline at end of file
@@ -14,18 +14,40 @@
 #endif
 
 #define VIDEO_BUFFER_SIZE 65536
+#define VIDEO_STREAM_SIZE (4 * VIDEO_BUFFER_SIZE * sizeof(float))
+#define VIDEO_STREAM_REGIONS 3
+#define EMITTER_CHUNK_SIZE (VIDEO_BUFFER_SIZE / 4)
+#define EMITTER_GRAIN_SIZE 16384
+#define EMITTER_GPU_CAPACITY 65536
+#define EMITTER_GPU_STRIDE 10
+#define EMITTER_GPU_WRAP 8388608
+#define VIDEO_QUEUE_LOOKBACK 64
+#define VIDEO_QUEUE_DATA (4 * VIDEO_BUFFER_SIZE)
+#define VIDEO_QUEUE_COMMANDS 16384
+#define VIDEO_STRIDE_MAX 9
+#define VIDEO_DATA_ALIGN 720
 
 typedef enum {
     VIDEO_PRIMITIVE,
     VIDEO_TEXTURED,
     VIDEO_PARTICLE,
-    VIDEO_PARTICLE_TEXTURED
+    VIDEO_PARTICLE_TEXTURED,
+    VIDEO_PARTICLE_GPU,
+    VIDEO_PARTICLE_GPU_TEXTURED,
+    VIDEO_SPRITE_INSTANCED
 } video_clazz;
 
+typedef struct video_transform_t {
+    float a, b, c, d, e, f;
+} video_transform_t;
+
 typedef struct video_cfg_t {
     video_mode mode;
     mat4_t projection;
+    video_transform_t transform;
     vec4_t color;
+    vec4_t tint;
+    uint32_t packed;
 } video_cfg_t;
 
 typedef struct video_env_t {
@@ -34,26 +56,116 @@ typedef struct video_env_t {
     GLuint program;
     GLuint attrib_position;
     GLuint attrib_tex_coord;
+    GLuint attrib_color;
     GLuint attrib_instance_offset;
     GLuint attrib_instance_color;
+    GLuint attrib_instance_velocity;
+    GLuint attrib_instance_time;
+    GLuint attrib_instance_dst;
+    GLuint attrib_instance_src;
     GLuint uniform_projection;
     GLuint uniform_color;
+    GLuint uniform_time;
+    vec4_t color;
     bool dirty;
 } video_env_t;
 
+typedef struct video_stream_t {
+    size_t offset;
+    int region;
+#ifndef __EMSCRIPTEN__
+    GLsync fences[VIDEO_STREAM_REGIONS];
+#endif
+} video_stream_t;
+
+typedef struct video_cmd_t {
+    video_env_t *env;
+    GLuint texture;
+    GLuint vbo;
+    vec4_t color;
+    GLenum mode;
+    vec4_t bounds;
+    size_t first;
+    size_t count;
+    size_t offset;
+    int next;
+} video_cmd_t;
+
+typedef struct video_batch_t {
+    video_env_t *env;
+    GLuint texture;
+    GLuint vbo;
+    vec4_t color;
+    GLenum mode;
+    vec4_t bounds;
+    int head;
+    int tail;
+} video_batch_t;
+
+typedef struct video_queue_t {
+    array_t *commands;
+    array_t *batches;
+    float *data;
+    size_t data_size;
+    size_t data_capacity;
+} video_queue_t;
+
+typedef struct video_part_t {
+    video_env_t *env;
+    GLuint texture;
+    vec4_t color;
+    GLenum mode;
+    vec4_t bounds;
+    size_t first;
+    size_t count;
+} video_part_t;
+
+struct video_mesh_t {
+    video_queue_t queue;
+    array_t *parts;
+    GLuint vbo;
+};
+
+typedef struct video_draw_t {
+    video_batch_t *batch;
+    size_t first;
+    size_t count;
+} video_draw_t;
+
 struct video_t {
     float *buffer;
     size_t buffer_size;
     GLuint vbo[2];
+    GLuint vbo_quad;
+    video_stream_t streams[2];
+    bool stream_sync;
     video_env_t env_primitive;
     video_env_t env_textured;
     video_env_t env_particles;
     video_env_t env_particles_textured;
+    video_env_t env_particles_gpu;
+    video_env_t env_particles_gpu_textured;
+    video_env_t env_sprite_instanced;
     video_env_t *env;
     array_t *configs;
     size_t batch_size;
+    GLint batch_first;
+    void (*batch_flush)(struct video_t*);
     float batch_sx;
     float batch_sy;
+    float batch_ox;
+    float batch_oy;
+    video_env_t *batch_env;
+    GLuint batch_texture;
+    bool deferred;
+    bool instanced;
+    char *shader_cache;
+    uint64_t shader_hash;
+    video_queue_t queue;
+    array_t *draws;
+    video_mesh_t *mesh;
+    video_stats_t stats;
+    video_stats_t stats_frame;
 };
 
 #define DDS_MAGIC       0x20534444
@@ -86,10 +198,23 @@ typedef struct dds_header_t {
     uint32_t reserved1;
 } dds_header_t;
 
+SDL_Surface *sprite_surface_load(const char *filename);
+void sprite_texture_params();
+
 GLenum video_env_set(video_t *self, video_env_t *env);
+void video_env_use(video_t *self, video_env_t *env, vec4_t color);
+void video_env_instances(video_t *self, video_env_t *env, size_t position, size_t color, size_t stride);
 void video_data_clear(video_t *self);
+void video_data_reserve(video_t *self, size_t count);
 void video_data_put2(video_t *self, float p0, float p1);
 void video_data_put4(video_t *self, float p0, float p1, float p2, float p3);
-void video_data_send(video_t *self, int vbo_index);
+void video_data_put_color(video_t *self, uint32_t color);
+uint32_t video_color_pack(vec4_t color);
+bool video_transform_identity(video_transform_t transform);
+bool video_transform_aligned(video_transform_t transform);
+size_t video_data_send(video_t *self, int vbo_index, size_t align);
+size_t video_data_write(video_t *self, int vbo_index, const void *data, size_t size, size_t align);
+void video_data_draw(video_t *self, GLenum mode, size_t count);
+void video_data_retained(video_t *self, GLenum mode, GLuint vbo, size_t first, size_t count, vec4_t bounds);
 
 #endif